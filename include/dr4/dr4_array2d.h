@@ -6,8 +6,10 @@
 
 #pragma once
 
+#include <dr4/dr4_parallel.h>
 #include <dr4/dr4_tuples.h>
 
+#include <algorithm>
 #include <utility>
 #include <vector>
 
@@ -90,9 +92,7 @@ namespace dr4 {
 		void setIfSmaller(size_t x, size_t y, const T& value) noexcept { if(m_data[index2d(x, y)] > value) m_data[index2d(x, y)] = value; }
 		void set(const PairIdx& idx, const T& value) { set(idx.x, idx.y, value); }
 
-		void setAll(const T& value) {
-			for (auto& v : m_data) v = value;
-		}
+		void setAll(const T& value) { fill(value); }
 
 		typedef typename std::vector<T>::const_iterator const_iterator_t;
 		typedef typename std::vector<T>::iterator iterator_t;
@@ -106,17 +106,81 @@ namespace dr4 {
 		}
 
 		void copyRowFrom(const Array2D<T>& src, PairIdx pos, PairIdx srcPos, size_t count) {
-			count = std::min(count, m_dim2 - pos.x);
+			count = std::min(count, m_dim1 - pos.x);
 			const_iterator_t srcStart = src.constIteratorAt(srcPos.x, srcPos.y);
 			const_iterator_t srcEnd = srcStart + count;
 			iterator_t targetStart = iteratorAt(pos.x, pos.y);
 			std::copy(srcStart, srcEnd, targetStart);
 		}
 
+		// Large arrays are filled in parallel, see parallelFor2D
 		void fill(const T& element) {
-			std::fill(m_data.begin(), m_data.end(), element);
+			parallelFor2D(*this, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+				std::fill(iteratorAt(0, band.y0), iteratorAt(0, band.y1), element);
+			});
+		}
+
+	};
+
+	// Non-owning view to a rectangular region of an Array2D. Rows of the view are strided by the
+	// row length of the viewed array. Views to non-overlapping regions may be written concurrently.
+	template<class T>
+	class Array2DView {
+		T* m_data;
+		size_t m_dim1;
+		size_t m_dim2;
+		size_t m_stride;
+	public:
+
+		Array2DView(Array2D<T>& src)
+			:m_data(src.data()), m_dim1(src.dim1()), m_dim2(src.dim2()), m_stride(src.dim1()) {
+		}
+
+		Array2DView(Array2D<T>& src, PairIdx origin, size_t dim1, size_t dim2)
+			:m_data(src.data() + src.index2d(origin.x, origin.y)), m_dim1(dim1), m_dim2(dim2), m_stride(src.dim1()) {
 		}
 
+		inline size_t index2d(size_t x, size_t y) const { return (y * m_stride) + x; }
+
+		size_t dim1() const { return m_dim1; }
+		size_t dim2() const { return m_dim2; }
+		size_t stride() const { return m_stride; }
+
+		std::pair<size_t, size_t> size() const { return { m_dim1, m_dim2 }; }
+
+		size_t elementCount() const { return m_dim1 * m_dim2; }
+
+		T* row(size_t y) { return m_data + y * m_stride; }
+		const T* row(size_t y) const { return m_data + y * m_stride; }
+
+		T& at(size_t x, size_t y) noexcept { return m_data[index2d(x, y)]; }
+		const T& at(size_t x, size_t y) const noexcept { return m_data[index2d(x, y)]; }
+
+		T& at(const PairIdx& idx) noexcept { return at(idx.x, idx.y); }
+		const T& at(const PairIdx& idx) const noexcept { return at(idx.x, idx.y); }
+
+		void set(size_t x, size_t y, const T& value) noexcept { m_data[index2d(x, y)] = value; }
+		void set(const PairIdx& idx, const T& value) { set(idx.x, idx.y, value); }
+
+		void setAll(const T& value) { fill(value); }
+
+		void fill(const T& element) {
+			parallelFor2D(*this, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+				for (size_t y = band.y0; y < band.y1; y++) {
+					T* r = row(y);
+					std::fill(r, r + m_dim1, element);
+				}
+			});
+		}
+
+		Array2D<T> toArray() const {
+			Array2D<T> res(m_dim1, m_dim2);
+			for (size_t y = 0; y < m_dim2; y++) {
+				const T* r = row(y);
+				std::copy(r, r + m_dim1, res.iteratorAt(0, y));
+			}
+			return res;
+		}
 	};
 
 }
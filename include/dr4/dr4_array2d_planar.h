@@ -0,0 +1,124 @@
+// This file is part of dr4w, a library for computer graphics routines.
+//
+// Copyright (C) 2020 Mikko Kuitunen <mikko.kuitunen@iki.fi>
+//
+// This Source Code Form is subject to the terms of the MIT License (see LICENSE.txt)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace dr4 {
+
+	// Two dimensional array storing each channel in its own plane (structure of arrays).
+	// Rows of every plane start at Alignment byte boundaries and are padded to stride() elements,
+	// so kernels may process full vector registers up to the stride without handling tails.
+	// Padding elements are zero initialized, kernels may write to them.
+	template<class T, size_t Channels>
+	class Array2DPlanar {
+	public:
+		static const size_t Alignment = 32;
+		static const size_t ChannelCount = Channels;
+
+	private:
+		T* m_data = nullptr;
+		size_t m_dim1 = 0;
+		size_t m_dim2 = 0;
+		size_t m_stride = 0;
+
+		static size_t StrideFor(size_t dim1) {
+			const size_t lanes = Alignment / sizeof(T);
+			return ((dim1 + lanes - 1) / lanes) * lanes;
+		}
+
+		size_t allocatedCount() const { return m_stride * m_dim2 * Channels; }
+
+		void allocate() {
+			const size_t count = allocatedCount();
+			if (count == 0)
+				return;
+			m_data = static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+			std::uninitialized_fill(m_data, m_data + count, T());
+		}
+
+		void release() {
+			if (m_data)
+				::operator delete(m_data, std::align_val_t(Alignment));
+			m_data = nullptr;
+		}
+
+	public:
+		Array2DPlanar(size_t dim1, size_t dim2)
+			:m_dim1(dim1), m_dim2(dim2), m_stride(StrideFor(dim1)) {
+			allocate();
+		}
+
+		Array2DPlanar(const std::pair<size_t, size_t>& dims) :Array2DPlanar(dims.first, dims.second) {}
+
+		Array2DPlanar(const Array2DPlanar& rhs)
+			:m_dim1(rhs.m_dim1), m_dim2(rhs.m_dim2), m_stride(rhs.m_stride) {
+			allocate();
+			std::copy(rhs.m_data, rhs.m_data + allocatedCount(), m_data);
+		}
+
+		Array2DPlanar(Array2DPlanar&& rhs) noexcept
+			:m_data(rhs.m_data), m_dim1(rhs.m_dim1), m_dim2(rhs.m_dim2), m_stride(rhs.m_stride) {
+			rhs.m_data = nullptr;
+			rhs.m_dim1 = rhs.m_dim2 = rhs.m_stride = 0;
+		}
+
+		Array2DPlanar& operator=(const Array2DPlanar& rhs) {
+			if (this != &rhs) {
+				Array2DPlanar copy(rhs);
+				*this = std::move(copy);
+			}
+			return *this;
+		}
+
+		Array2DPlanar& operator=(Array2DPlanar&& rhs) noexcept {
+			if (this != &rhs) {
+				release();
+				m_data = rhs.m_data;
+				m_dim1 = rhs.m_dim1;
+				m_dim2 = rhs.m_dim2;
+				m_stride = rhs.m_stride;
+				rhs.m_data = nullptr;
+				rhs.m_dim1 = rhs.m_dim2 = rhs.m_stride = 0;
+			}
+			return *this;
+		}
+
+		~Array2DPlanar() { release(); }
+
+		size_t dim1() const { return m_dim1; }
+		size_t dim2() const { return m_dim2; }
+		size_t stride() const { return m_stride; }
+
+		std::pair<size_t, size_t> size() const { return { m_dim1, m_dim2 }; }
+
+		size_t elementCount() const { return m_dim1 * m_dim2; }
+
+		T* plane(size_t channel) { return m_data + channel * m_stride * m_dim2; }
+		const T* plane(size_t channel) const { return m_data + channel * m_stride * m_dim2; }
+
+		T* row(size_t channel, size_t y) { return plane(channel) + y * m_stride; }
+		const T* row(size_t channel, size_t y) const { return plane(channel) + y * m_stride; }
+
+		T& at(size_t channel, size_t x, size_t y) noexcept { return row(channel, y)[x]; }
+		const T& at(size_t channel, size_t x, size_t y) const noexcept { return row(channel, y)[x]; }
+
+		void fillChannel(size_t channel, const T& value) {
+			std::fill(plane(channel), plane(channel) + m_stride * m_dim2, value);
+		}
+
+		void fill(const std::array<T, Channels>& values) {
+			for (size_t c = 0; c < Channels; c++)
+				fillChannel(c, values[c]);
+		}
+	};
+
+}
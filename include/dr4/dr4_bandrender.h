@@ -0,0 +1,61 @@
+#pragma once
+
+#include <dr4/dr4_rasterizer.h>
+#include <dr4/dr4_image.h>
+
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dr4 {
+
+	// Receives the bands of an image in order, top band first. rows holds rowCount rows of the image width,
+	// the image rows firstRow...firstRow+rowCount-1. Return a non-empty error string to stop rendering.
+	typedef std::function<std::string(size_t firstRow, size_t rowCount, const SRGBA* rows)> BandOutput;
+
+	struct BandRenderConfig {
+		// Image rows rendered at once
+		unsigned bandHeight = 256;
+		// Bands in flight, output of a band overlaps rendering of the following ones.
+		// Working set is about depth bands of render buffer and one sRGB band.
+		size_t depth = 2;
+		RasterizerConfig rasterizer = RasterizerConfig::Tiled(256, 256);
+	};
+
+	// Render the frame of config in horizontal bands without holding the whole frame in memory.
+	// Output matches a single frame render exactly.
+	// Return empty string on success, otherwise the error.
+	std::string RenderBands(RasterConfig2D config, const Scene2D& scene, BandOutput output,
+		BandRenderConfig bandConfig = BandRenderConfig());
+
+	// Render in bands and stream the bands to a PNG file
+	std::string RenderBandsToPng(RasterConfig2D config, const Scene2D& scene, const std::string& path,
+		BandRenderConfig bandConfig = BandRenderConfig());
+
+	// Writes a PNG file incrementally, a few rows at a time. Pixel data is stored in uncompressed deflate blocks,
+	// so the encoder needs no window or state beyond the checksums and the file size is about 4 * width * height.
+	class PngStreamWriter {
+	public:
+		~PngStreamWriter();
+
+		// Create file and write header. Return empty string on success, otherwise the error.
+		std::string open(const std::string& path, size_t width, size_t height);
+		// Append rows of width pixels
+		std::string writeRows(const SRGBA* rows, size_t rowCount);
+		// Finish the file, all rows must have been written
+		std::string close();
+
+	private:
+		void writeChunk(const char* type, const uint8_t* data, size_t size);
+
+		std::ofstream m_file;
+		std::string m_path;
+		size_t m_width = 0;
+		size_t m_height = 0;
+		size_t m_rowsWritten = 0;
+		uint32_t m_adlerA = 1;
+		uint32_t m_adlerB = 0;
+		std::vector<uint8_t> m_chunk;
+	};
+}
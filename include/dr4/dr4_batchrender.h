@@ -0,0 +1,67 @@
+#pragma once
+
+#include <dr4/dr4_rasterizer.h>
+#include <dr4/dr4_span2f.h>
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dr4 {
+
+	// Render a scene file to a PNG file
+	struct BatchJob {
+		std::string scenePath; // Scene2D as JSON, see JsonParser
+		std::string outputPath;
+		unsigned width = 0;
+		unsigned height = 0;
+		// Scene area stretched to the image. Without a view the image shows a unit high area centered at the origin.
+		std::optional<Span2f> view;
+	};
+
+	struct BatchJobResult {
+		std::string error; // empty on success
+		size_t worker = 0;
+		// Time from the start of the batch to the start of the job, and the time spent in each stage
+		double startMs = 0.0;
+		double readMs = 0.0;
+		double parseMs = 0.0;
+		double renderMs = 0.0; // rasterization and conversion to sRGB
+		double encodeMs = 0.0;
+	};
+
+	struct BatchRenderConfig {
+		// Jobs in progress at once, zero uses the hardware concurrency. Rasterization tasks of all jobs share the
+		// parallel executor, so parsing and encoding of some jobs overlap rendering of others.
+		size_t workers = 0;
+		RasterizerConfig rasterizer = RasterizerConfig::Tiled(128, 128);
+		// Called on the worker thread as each job completes
+		std::function<void(size_t jobIndex, const BatchJobResult& result)> progress;
+	};
+
+	struct BatchReport {
+		std::vector<BatchJobResult> results; // in job order
+		size_t workers = 0;
+		size_t failed = 0;
+		size_t rasterizersCreated = 0;
+		double wallMs = 0.0;
+
+		double jobsPerSecond() const { return wallMs > 0.0 ? 1e3 * (double)results.size() / wallMs : 0.0; }
+	};
+
+	// Render the jobs with a bounded number of workers. Render buffers are reused between jobs of the same image size.
+	BatchReport RenderBatch(const std::vector<BatchJob>& jobs, BatchRenderConfig config = BatchRenderConfig());
+
+	// Read jobs from a JSON manifest:
+	// { "width": 1920, "height": 1080,
+	//   "jobs": [ { "scene": "a.json", "output": "a.png" },
+	//             { "scene": "b.json", "output": "b.png", "width": 640, "height": 480, "view": [xmin, ymin, xmax, ymax] } ] }
+	// Top level width and height are defaults for the jobs, sizes are unsigned integers. Relative paths are relative
+	// to the manifest.
+	// Return empty string on success, otherwise the error.
+	std::string ReadBatchManifest(const std::string& path, std::vector<BatchJob>& jobs);
+
+	// Per job timings and totals of a batch as JSON
+	std::string BatchReportJson(const std::vector<BatchJob>& jobs, const BatchReport& report);
+}
@@ -41,6 +41,9 @@ namespace dr4 {
 
 		RasterDomain m_rasterDomain;
 		SceneDomain m_sceneDomain;
+		// Raster position of the left lower pixel of the rendered buffer. A rasterizer smaller than the raster
+		// domain renders the part of the domain starting here, with the same coverage as a full frame render.
+		PairIdx bufferOrigin = { 0, 0 };
 
 		inline LinearMap2D rasterToScene() const {
 			Pairf offset = {-1.f * ((float) m_rasterDomain.origin.x), -1.f * ((float)m_rasterDomain.origin.y)};
@@ -92,6 +92,22 @@ namespace dr4 {
 		static RGBAFloat32 Pink() { return{ 1.f, 105.f / 255.f, 180.f / 255.f, 1.f }; } // Actually HotPink...
 	};
 
+	/** Premultiplied linear colorspace, IEEE half precision channels */
+	struct RGBAHalf16 {
+		uint16_t r;
+		uint16_t g;
+		uint16_t b;
+		uint16_t a;
+	};
+
+	/** Premultiplied sRGB encoded color. Color channels are encoded first, then multiplied with alpha. */
+	struct SRGBA8Premultiplied {
+		uint8_t r;
+		uint8_t g;
+		uint8_t b;
+		uint8_t a;
+	};
+
 	struct LABFloat32 {
 		float l;
 		float a;
@@ -0,0 +1,48 @@
+// This file is part of dr4w, a library for computer graphics routines.
+//
+// Copyright (C) 2020 Mikko Kuitunen <mikko.kuitunen@iki.fi>
+//
+// This Source Code Form is subject to the terms of the MIT License (see LICENSE.txt)
+
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DR4_X86 1
+#endif
+
+// Functions using instruction set extensions beyond the compilation baseline must be annotated for gcc and clang.
+// MSVC allows intrinsics in any function.
+#if defined(DR4_X86) && (defined(__GNUC__) || defined(__clang__))
+#define DR4_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define DR4_TARGET_AVX2 __attribute__((target("avx2")))
+#define DR4_TARGET_F16C __attribute__((target("avx,f16c")))
+#else
+#define DR4_TARGET_SSE41
+#define DR4_TARGET_AVX2
+#define DR4_TARGET_F16C
+#endif
+
+namespace dr4 {
+
+	// Vector instruction set used by kernels that have several implementations
+	enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+	// Instruction set extensions available on the running processor
+	struct CpuFeatures {
+		bool sse2 = false;
+		bool sse41 = false;
+		bool avx2 = false;
+		bool f16c = false;
+
+		SimdLevel bestSimdLevel() const {
+			if (avx2) return SimdLevel::AVX2;
+			if (sse2) return SimdLevel::SSE2;
+			return SimdLevel::Scalar;
+		}
+
+		// Features are detected once on first call
+		static const CpuFeatures& Get();
+	};
+
+	const char* SimdLevelToString(SimdLevel level);
+}
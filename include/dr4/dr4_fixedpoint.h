@@ -0,0 +1,38 @@
+// This file is part of dr4w, a library for computer graphics routines.
+//
+// Copyright (C) 2020 Mikko Kuitunen <mikko.kuitunen@iki.fi>
+//
+// This Source Code Form is subject to the terms of the MIT License (see LICENSE.txt)
+
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+namespace dr4 {
+
+	// Sub-pixel fixed point raster coordinates used by the rasterization kernels
+	struct Subpixel {
+		static constexpr int Bits = 4;
+		static constexpr int64_t Scale = 1 << Bits;
+		static constexpr int64_t Half = Scale / 2;
+		// Keeps products of edge function coefficients well within int64
+		static constexpr float MaxCoordinate = (float)(1 << 24);
+
+		static int64_t Snap(float v) {
+			if (!(v > -MaxCoordinate)) v = -MaxCoordinate; // also catches nan
+			if (v > MaxCoordinate) v = MaxCoordinate;
+			return (int64_t)std::llround((double)v * (double)Scale);
+		}
+
+		// Sample position of the center of pixel
+		static int64_t Center(int64_t pixel) { return pixel * Scale + Half; }
+
+		// Pixel containing the sub-pixel coordinate
+		static int64_t Pixel(int64_t v) { return FloorDiv(v, Scale); }
+
+		static int64_t FloorDiv(int64_t a, int64_t b) {
+			int64_t q = a / b;
+			return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+		}
+	};
+}
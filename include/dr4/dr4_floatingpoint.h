@@ -9,6 +9,7 @@
 #include <limits>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 
 
 namespace dr4 {
@@ -75,11 +76,11 @@ namespace dr4 {
 			// We first check if the values are NaN.
 			// If this is the case, they're inherently unequal;
 			// return the maximum distance between the two.
-			if (isnan(a) || isnan(b)) return max;
+			if (std::isnan(a) || std::isnan(b)) return max;
 
 			// If one's infinite, and they're not equal,
 			// return the max distance between the two.
-			if (isinf(a) || isinf(b)) return max;
+			if (std::isinf(a) || std::isinf(b)) return max;
 
 			// At this point we know that the floating-point values aren't equal and
 			// aren't special values (infinity/NaN).
@@ -171,11 +172,11 @@ namespace dr4 {
 			// We first check if the values are NaN.
 			// If this is the case, they're inherently unequal;
 			// return the maximum distance between the two.
-			if (isnan(a) || isnan(b)) return max;
+			if (std::isnan(a) || std::isnan(b)) return max;
 
 			// If one's infinite, and they're not equal,
 			// return the max distance between the two.
-			if (isinf(a) || isinf(b)) return max;
+			if (std::isinf(a) || std::isinf(b)) return max;
 
 			// At this point we know that the floating-point values aren't equal and
 			// aren't special values (infinity/NaN).
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <dr4/dr4_rasterizer.h>
+#include <dr4/dr4_image.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dr4 {
+
+	// Receives the sRGB image of a completed frame on a background thread
+	typedef std::function<void(size_t frameIndex, const ImageRGBA8SRGB& image)> FrameOutput;
+
+	struct FramePipelineConfig {
+		// Frames in flight. Each has its own render buffer, so memory use is fixed by the depth.
+		size_t depth = 2;
+		// Background threads converting and outputting frames. Each holds one converted image while outputting it.
+		size_t workers = 1;
+		RasterizerConfig rasterizer = RasterizerConfig::SingleTile();
+	};
+
+	// Renders frames while the previous frames are converted to sRGB and output on background threads.
+	// submit rasterizes on the calling thread, in parallel tasks, and returns as soon as the frame is queued for
+	// output. When all render buffers are waiting for output, submit blocks until one is free.
+	class FramePipeline {
+	public:
+		FramePipeline(unsigned width, unsigned height, FramePipelineConfig config = FramePipelineConfig());
+		~FramePipeline();
+
+		FramePipeline(const FramePipeline&) = delete;
+		FramePipeline& operator=(const FramePipeline&) = delete;
+
+		// Render scene and queue the result to output. The scene is not referenced after submit returns.
+		// Returns the index of the frame.
+		size_t submit(RasterConfig2D config, const Scene2D& scene, FrameOutput output);
+
+		// Wait until all submitted frames have been output
+		void finish();
+
+		// Output writing the frame as a PNG file
+		static FrameOutput WritePng(const std::string& path);
+
+	private:
+		struct Slot {
+			std::shared_ptr<IRasterizer> rasterizer;
+			bool busy = false;
+		};
+
+		struct Job {
+			size_t slot;
+			size_t frameIndex;
+			FrameOutput output;
+		};
+
+		void workerLoop();
+
+		std::vector<Slot> m_slots;
+		std::deque<Job> m_queue; // bounded by the slot count
+		std::vector<std::thread> m_workers;
+		std::mutex m_mutex;
+		std::condition_variable m_jobQueued;
+		std::condition_variable m_slotFreed;
+		size_t m_pending = 0; // frames submitted but not output
+		size_t m_nextFrame = 0;
+		size_t m_nextSlot = 0;
+		bool m_stop = false;
+	};
+}
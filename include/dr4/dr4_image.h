@@ -19,6 +19,11 @@ namespace dr4 {
 	uint8_t LinearFloatToSRGBUint8(const float f);
 	float SRGBUint8ToLinearFloat(const uint8_t u);
 
+	// Convert count consecutive pixels. Vectorized, results are identical to ToSRGBA and ToRGBAFloat per pixel.
+	void LinearToSRGBRow(const RGBAFloat32* linear, SRGBA* srgb, size_t count);
+	void SRGBToLinearRow(const SRGBA* srgb, RGBAFloat32* linear, size_t count);
+
+	// Whole image conversions run the row kernels in parallel bands of rows
 	ImageRGBA8SRGB convertRBGA32LinearToSrgb(const ImageRGBA32Linear& linear);
 	ImageRGBA32Linear convertToLinear(const ImageRGBA8SRGB& srgb);
 
@@ -0,0 +1,41 @@
+// This file is part of dr4w, a library for computer graphics routines.
+//
+// Copyright (C) 2020 Mikko Kuitunen <mikko.kuitunen@iki.fi>
+//
+// This Source Code Form is subject to the terms of the MIT License (see LICENSE.txt)
+#pragma once
+
+#include <dr4/dr4_image.h>
+#include <dr4/dr4_array2d_planar.h>
+
+namespace dr4 {
+
+	// Linear RGBA with channel planes r, g, b, a
+	typedef Array2DPlanar<float, 4> ImageRGBA32LinearPlanar;
+	// Single channel image, e.g. coverage or alpha mask
+	typedef Array2DPlanar<float, 1> ImageFloat32Planar;
+
+	ImageRGBA32LinearPlanar convertToPlanar(const ImageRGBA32Linear& image);
+	ImageRGBA32Linear convertToInterleaved(const ImageRGBA32LinearPlanar& image);
+
+	//
+	// Planar variants of the per pixel color functions. Images must have equal dimensions.
+	// Kernels process full rows up to the stride, results match the interleaved functions per pixel.
+	//
+
+	// Painter::fill
+	void Fill(ImageRGBA32LinearPlanar& target, const RGBAFloat32& color);
+
+	// BlendAlpha of source over target, result written to target
+	void BlendAlpha(const ImageRGBA32LinearPlanar& source, ImageRGBA32LinearPlanar& target);
+
+	// BlendAlpha of color with alpha scaled by coverage over target
+	void BlendAlpha(const RGBAFloat32& color, const ImageFloat32Planar& coverage, ImageRGBA32LinearPlanar& target);
+
+	// Lerp from src to dst by u
+	void Lerp(const ImageRGBA32LinearPlanar& src, const ImageRGBA32LinearPlanar& dst, float u, ImageRGBA32LinearPlanar& result);
+
+	// Lerp from src to dst by a per pixel u
+	void Lerp(const ImageRGBA32LinearPlanar& src, const ImageRGBA32LinearPlanar& dst, const ImageFloat32Planar& u,
+		ImageRGBA32LinearPlanar& result);
+}
@@ -12,6 +12,9 @@ namespace dr4 {
 	};
 	std::string JsonParseResultToString(JsonParseResult j);
 
+	template<> inline JsonParseResult SuccessValue<JsonParseResult>() { return JsonParseResult::Success; }
+	template<> inline std::string MetaToString<JsonParseResult>(const JsonParseResult& m) { return JsonParseResultToString(m); }
+
 	class JsonImpl;
 	class Json {
 	public:
@@ -22,6 +25,7 @@ namespace dr4 {
 			else
 				return false;
 		}
+		std::string toString() const;
 		std::string compress() const;
 		static Json Deflate(const std::string& compressed);
 	};
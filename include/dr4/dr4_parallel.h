@@ -0,0 +1,54 @@
+// This file is part of dr4w, a library for computer graphics routines.
+//
+// Copyright (C) 2020 Mikko Kuitunen <mikko.kuitunen@iki.fi>
+//
+// This Source Code Form is subject to the terms of the MIT License (see LICENSE.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace dr4 {
+
+	// How parallelFor2D splits an array into work items
+	struct ParallelGrain {
+		static const size_t DefaultMinElements = 1 << 16;
+
+		// Elements per work item, enough to amortize scheduling. Arrays with fewer than two items of work are
+		// processed on the calling thread.
+		size_t minElements = DefaultMinElements;
+		// Zero splits into bands of full rows. Otherwise the array is split into blocks this many elements wide,
+		// which keeps the rows of a block in cache for functions reading neighbouring rows.
+		size_t blockWidth = 0;
+
+		static ParallelGrain Rows(size_t minElements = DefaultMinElements) { return { minElements, 0 }; }
+		static ParallelGrain Blocks(size_t blockWidth, size_t minElements = DefaultMinElements) {
+			return { minElements, blockWidth };
+		}
+	};
+
+	// Elements [x0, x1) of rows [y0, y1)
+	struct ParallelRange2D {
+		size_t x0, y0, x1, y1;
+
+		size_t width() const { return x1 - x0; }
+		size_t height() const { return y1 - y0; }
+	};
+
+	class ThreadPool;
+
+	// Call fun for non-overlapping ranges covering width x height elements, in parallel on pool, and return when
+	// all calls are done. Safe to call from within a task.
+	void parallelFor2D(ThreadPool& pool, size_t width, size_t height, ParallelGrain grain,
+		const std::function<void(const ParallelRange2D&)>& fun);
+
+	// parallelFor2D on the global thread pool
+	void parallelFor2D(size_t width, size_t height, ParallelGrain grain, const std::function<void(const ParallelRange2D&)>& fun);
+
+	// Call fun for ranges covering the elements of a two dimensional array, see Array2D and Array2DView
+	template<class Array, class Fun>
+	void parallelFor2D(Array& array, ParallelGrain grain, Fun fun) {
+		parallelFor2D(array.dim1(), array.dim2(), grain, std::function<void(const ParallelRange2D&)>(fun));
+	}
+}
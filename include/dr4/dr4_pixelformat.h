@@ -0,0 +1,72 @@
+// This file is part of dr4w, a library for computer graphics routines.
+//
+// Copyright (C) 2020 Mikko Kuitunen <mikko.kuitunen@iki.fi>
+//
+// This Source Code Form is subject to the terms of the MIT License (see LICENSE.txt)
+
+#pragma once
+
+#include <dr4/dr4_color.h>
+#include <dr4/dr4_image.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dr4 {
+
+	// Storage formats of render targets
+	enum class RenderFormat {
+		RGBA32F, // straight alpha linear float, 16 bytes per pixel
+		RGBA16FPremultiplied, // premultiplied linear half float, 8 bytes per pixel
+		RGBA8Premultiplied // premultiplied sRGB encoded, 4 bytes per pixel. Blends in the encoded space.
+	};
+
+	const char* RenderFormatToString(RenderFormat format);
+
+	uint16_t FloatToHalf(float f);
+	float HalfToFloat(uint16_t h);
+
+	// Pixel format traits: conversions between the stored pixels and straight alpha linear colors, and the
+	// kernels writing to pixel rows. Rasterization kernels are instantiated for each pixel type.
+	//
+	// BlendSpan blends the encoded source pixel over count pixels of a row, scaled by per pixel coverage.
+	// CompositeSpan blends a row of pixels of another buffer over the row, scaled by opacity.
+	template<class Pixel>
+	struct PixelFormat;
+
+	template<>
+	struct PixelFormat<RGBAFloat32> {
+		static constexpr RenderFormat Format = RenderFormat::RGBA32F;
+		static RGBAFloat32 Encode(const RGBAFloat32& color) { return color; }
+		static RGBAFloat32 Decode(const RGBAFloat32& pixel) { return pixel; }
+		static void BlendSpan(RGBAFloat32* row, const float* coverage, size_t count, const RGBAFloat32& src);
+		static void FillSpan(RGBAFloat32* row, size_t count, const RGBAFloat32& pixel);
+		static void CompositeSpan(RGBAFloat32* row, const RGBAFloat32* src, size_t count, float opacity);
+		static ImageRGBA8SRGB ToSRGB(const Array2D<RGBAFloat32>& image);
+	};
+
+	template<>
+	struct PixelFormat<RGBAHalf16> {
+		static constexpr RenderFormat Format = RenderFormat::RGBA16FPremultiplied;
+		static RGBAHalf16 Encode(const RGBAFloat32& color);
+		static RGBAFloat32 Decode(const RGBAHalf16& pixel);
+		static void BlendSpan(RGBAHalf16* row, const float* coverage, size_t count, const RGBAHalf16& src);
+		static void FillSpan(RGBAHalf16* row, size_t count, const RGBAHalf16& pixel);
+		static void CompositeSpan(RGBAHalf16* row, const RGBAHalf16* src, size_t count, float opacity);
+		static ImageRGBA8SRGB ToSRGB(const Array2D<RGBAHalf16>& image);
+	};
+
+	template<>
+	struct PixelFormat<SRGBA8Premultiplied> {
+		static constexpr RenderFormat Format = RenderFormat::RGBA8Premultiplied;
+		static SRGBA8Premultiplied Encode(const RGBAFloat32& color);
+		static RGBAFloat32 Decode(const SRGBA8Premultiplied& pixel);
+		static void BlendSpan(SRGBA8Premultiplied* row, const float* coverage, size_t count, const SRGBA8Premultiplied& src);
+		static void FillSpan(SRGBA8Premultiplied* row, size_t count, const SRGBA8Premultiplied& pixel);
+		static void CompositeSpan(SRGBA8Premultiplied* row, const SRGBA8Premultiplied* src, size_t count, float opacity);
+		static ImageRGBA8SRGB ToSRGB(const Array2D<SRGBA8Premultiplied>& image);
+	};
+
+	typedef Array2D<RGBAHalf16> ImageRGBA16FPremultiplied;
+	typedef Array2D<SRGBA8Premultiplied> ImageRGBA8SRGBPremultiplied;
+}
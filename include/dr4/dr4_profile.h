@@ -0,0 +1,38 @@
+#pragma once
+
+#include <dr4/dr4_rasterizer.h>
+
+#include <string>
+#include <vector>
+
+namespace dr4 {
+
+	// Profile of a frame copied from FrameTasks, so that the tasks can be released
+	struct FrameProfile {
+		size_t frameIndex = 0;
+		std::vector<ProfileEvent> steps; // rasterizer steps
+		std::vector<ProfileEvent> tasks;
+	};
+
+	// Collect the profile of a frame rendered with FrameTasks::profile set
+	FrameProfile CollectFrameProfile(const FrameTasks& tasks, size_t frameIndex);
+
+	struct FrameProfileSummary {
+		size_t taskCount = 0;
+		size_t threadCount = 0; // distinct threads running tasks
+		double wallMs = 0.0; // from the first start to the last end of steps and tasks
+		double taskMs = 0.0; // sum of task durations
+		double maxTaskMs = 0.0;
+		// Totals over steps and tasks
+		uint64_t primitives = 0;
+		uint64_t pixels = 0;
+		uint64_t bytesAllocated = 0;
+	};
+
+	FrameProfileSummary SummarizeFrame(const FrameProfile& profile);
+
+	// Frames in the Chrome trace event format, viewable in chrome://tracing or Perfetto
+	std::string ChromeTraceJson(const std::vector<FrameProfile>& frames);
+	// Return empty string on success, otherwise the error
+	std::string writeChromeTrace(const std::vector<FrameProfile>& frames, const std::string& path);
+}
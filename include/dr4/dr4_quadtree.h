@@ -7,7 +7,7 @@
 #include <stack>
 
 #include <dr4/dr4_math.h>
-#include <dr4\dr4_tuples.h>
+#include <dr4/dr4_tuples.h>
 
 namespace dr4 {
 
@@ -4,12 +4,17 @@
 #include <dr4/dr4_scene2d.h>
 #include <dr4/dr4_camera.h>
 #include <dr4/dr4_image.h>
+#include <dr4/dr4_pixelformat.h>
 
 namespace dr4 {
 
 	class FrameTasks {
 	public:
 		ITask::Collection tasks;
+		// Set before draw2D to profile the frame. Tasks are then created with profiling enabled and the rasterizer
+		// records its own steps to events. See dr4_profile.h for summaries and trace export.
+		bool profile = false;
+		std::vector<ProfileEvent> events;
 	};
 
 	// Rasterizer is an interface to rendering algorithm
@@ -17,13 +22,46 @@ namespace dr4 {
 	class IRasterizer {
 	public:
 		virtual ~IRasterizer() {}
-		// Append to task queue in frame tasks. Frame task results are to be applied to the render buffer in order
+		// Append to task queue in frame tasks. Tasks may depend on each other, run them with an executor and then
+		// call applyResult.
 		virtual void draw2D(RasterConfig2D config, const Scene2D& scene, FrameTasks& tasks) = 0;
 		virtual void applyResult(FrameTasks& tasks) = 0;
+		// Render the whole frame on the next draw2D. With RasterizerConfig::incremental, draw2D otherwise renders
+		// only areas affected by changes registered to the scene since the previous draw2D of the same scene.
+		virtual void invalidate() = 0;
 		//virtual void draw(Camera3D camera, const Scene3D& scene) = 0;
 		virtual ImageRGBA8SRGB getColorAsSRGB() const = 0;
 	};
 	
+	// Rasterizer construction options
+	struct RasterizerConfig {
+		// Dimensions of a render tile in pixels. The frame is split into tiles, each rendered by a separate task.
+		// Zero dimension renders the whole frame as a single tile.
+		unsigned tileWidth = 0;
+		unsigned tileHeight = 0;
+		// Storage format of the frame. Compact formats use less memory bandwidth per blended pixel.
+		RenderFormat format = RenderFormat::RGBA32F;
+		// Keep the previous frame and re-render only the areas affected by the changes registered to the scene
+		// since then (Scene2D::markChanged). Edits that are not registered are then not rendered.
+		bool incremental = false;
+
+		static RasterizerConfig SingleTile() { return { 0, 0 }; }
+		static RasterizerConfig Tiled(unsigned tileWidth, unsigned tileHeight) { return { tileWidth, tileHeight }; }
+
+		RasterizerConfig withFormat(RenderFormat renderFormat) const {
+			RasterizerConfig res = *this;
+			res.format = renderFormat;
+			return res;
+		}
+
+		RasterizerConfig withIncremental(bool enabled = true) const {
+			RasterizerConfig res = *this;
+			res.incremental = enabled;
+			return res;
+		}
+	};
+	
 	std::shared_ptr<IRasterizer> CreateRasterizer(unsigned width, unsigned height);
+	std::shared_ptr<IRasterizer> CreateRasterizer(unsigned width, unsigned height, RasterizerConfig config);
 
 }
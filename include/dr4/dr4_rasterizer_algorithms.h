@@ -2,7 +2,10 @@
 
 #include <dr4/dr4_image.h>
 #include <dr4/dr4_rasterizer_area.h>
+#include <dr4/dr4_cpu.h>
+#include <dr4/dr4_pixelformat.h>
 
+#include <cmath>
 #include <map>
 
 namespace dr4 {
@@ -11,10 +14,43 @@ namespace dr4 {
         std::map<float, RGBAFloat32> points;
     };
 
-    struct Painter {
-        ImageRGBA32Linear& m_img;
+    typedef Array2DView<RGBAFloat32> ImageRGBA32LinearView;
+
+    enum class GradientShape { Linear, Radial, Conic };
+
+    // Maps raster positions to the gradient parameter t, the coordinate of the color lookup table.
+    // Linear: t grows from 0 at fst to 1 at snd along the line between them.
+    // Radial: t is the distance from the center fst divided by the distance from fst to snd.
+    // Conic: t is the counterclockwise angle around the center fst in turns, starting from the direction of snd.
+    struct GradientGeometry {
+        GradientShape shape;
+        Pairf fst;
+        Pairf snd;
+
+        static GradientGeometry Linear(Pairf from, Pairf to) { return { GradientShape::Linear, from, to }; }
+        static GradientGeometry Radial(Pairf center, float radius) {
+            return { GradientShape::Radial, center, { center.x + radius, center.y } };
+        }
+        static GradientGeometry Conic(Pairf center, float startAngle) {
+            return { GradientShape::Conic, center, { center.x + cosf(startAngle), center.y + sinf(startAngle) } };
+        }
+    };
+
+    // Blends the gradient over the pixels of the image within clip, in y-up raster coordinates of the image.
+    // The parameter is stepped incrementally along rows, the table is interpolated linearly and clamped at
+    // its ends, and pixels are blended eight at a time with AVX2.
+    void FillGradient(ImageRGBA32LinearView image, const GradientGeometry& geometry, const LookUpTable<RGBAFloat32>& lut,
+        RasterDomain clip);
+
+    // Painter writes to an image of Pixel type (see PixelFormat). Functions taking colors as RGBAFloat32
+    // are available for RGBAFloat32 images only.
+    template<class Pixel>
+    struct PainterT {
+        typedef Pixel pixel_type;
+        Array2DView<Pixel> m_img;
         size_t height;
-        Painter(dr4::ImageRGBA32Linear& img) :m_img(img), height(img.dim2()) {}
+        PainterT(Array2D<Pixel>& img) :m_img(img), height(img.dim2()) {}
+        PainterT(Array2DView<Pixel> img) :m_img(img), height(img.dim2()) {}
 
         RasterDomain getFullRasterDomain() {
             auto size = m_img.size();
@@ -31,31 +67,18 @@ namespace dr4 {
         void strokeByDistance() {
         }
 
-        void fill(const dr4::RGBAFloat32& color) {
-            m_img.fill(color);
+        void fill(const Pixel& pixel) {
+            m_img.fill(pixel);
         }
 
         void applyGradient(Pairf fst, Pairf snd, LookUpTable<RGBAFloat32>& grad) {
-
             assert(!fst.isEqualTo(snd));
+            fillGradient(GradientGeometry::Linear(fst, snd), grad, getFullRasterDomain());
+        }
 
-
-            auto dline = snd - fst;
-            auto len = dline.norm();
-
-            dline = dline.normalized();
-
-            auto d = Pairf{ dline.y, dline.x};
-
-            for (unsigned i = 0; i < m_img.dim2(); i++) {
-                for (unsigned j = 0; j < m_img.dim1(); j++) {
-                    Pairf y = {(float)j,(float)i};
-                    auto delta = y - fst;
-                    auto lenAlong = delta.dot(dline);
-                    auto rel = lenAlong / len;
-                    BlendPixeli(j, i, grad.getNearest(rel));
-                }
-            }
+        // Available for RGBAFloat32 painters, see FillGradient
+        void fillGradient(const GradientGeometry& geometry, const LookUpTable<RGBAFloat32>& lut, RasterDomain clip) {
+            FillGradient(m_img, geometry, lut, clip);
         }
 
         inline void SetPixel(float x, float y, const dr4::RGBAFloat32& color)
@@ -110,6 +133,11 @@ namespace dr4 {
             m_img.set(x, (height - y - 1), out);
         }
 
+        // Pixel row y in the y-up raster coordinates
+        inline Pixel* row(unsigned y) {
+            return m_img.row(height - y - 1);
+        }
+
         inline void SetPixelNatural(float x, float y, const dr4::RGBAFloat32& color)
         {
             if (x < 0.0f || y < 0.0f)
@@ -119,11 +147,15 @@ namespace dr4 {
         }
 
         void writeOut(const std::string& filename) {
-            auto srgb = convertRBGA32LinearToSrgb(m_img);
+            auto srgb = convertRBGA32LinearToSrgb(m_img.toArray());
             writeImageAsPng(srgb, filename);
         }
     };
 
+    typedef PainterT<RGBAFloat32> Painter;
+    typedef PainterT<RGBAHalf16> PainterRGBA16F;
+    typedef PainterT<SRGBA8Premultiplied> PainterRGBA8;
+
     // These work from the presumption that 0,0 is at left lower corner - so the mapping to the natural pixel
     // coordinates where y=0 is the top row is done internally
     class Razz {
@@ -143,5 +175,39 @@ namespace dr4 {
         // halfspace with incremental row differentials
         static void DrawTriangle3(Painter& p, const RGBAFloat32& color1, float x1, float y1,
             float x2, float y2, float x3, float y3);
+
+        // Kernels below are available for all pixel formats. Colors are straight alpha linear and converted
+        // to the format of the painter.
+
+        // halfspace with fixed point edge functions and the top-left fill rule. The painter origin is at
+        // (offsetx, offsety) in the raster coordinates of the vertices. Spans are found with scalar code unless a
+        // vector instruction set is given as level, which is capped to the instruction sets of the processor.
+        template<class Pixel>
+        static void DrawTriangleFixed(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf a, Pairf b, Pairf c,
+            int offsetx = 0, int offsety = 0);
+        template<class Pixel>
+        static void DrawTriangleFixed(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf a, Pairf b, Pairf c,
+            int offsetx, int offsety, SimdLevel level);
+
+        // DrawTriangleFixed picks one of these traversals by triangle size. Hierarchical classifies 8x8 blocks
+        // to fill or skip them whole, scanline finds the covered span of every row of the bounding box.
+        template<class Pixel>
+        static void DrawTriangleHierarchical(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf a, Pairf b, Pairf c,
+            int offsetx, int offsety, SimdLevel level);
+        template<class Pixel>
+        static void DrawTriangleScanline(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf a, Pairf b, Pairf c,
+            int offsetx, int offsety, SimdLevel level);
+
+        // Integer DDA line clipped to the painter once. The painter origin is at (offsetx, offsety) in the raster
+        // coordinates of the end points.
+        template<class Pixel>
+        static void DrawLineFixed(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf fst, Pairf snd,
+            int offsetx = 0, int offsety = 0);
+
+        // Anti-aliased line of given width in pixels with round caps. Coverage is computed from the distance of the
+        // pixel center to the segment, only pixels within reach of the segment are evaluated.
+        template<class Pixel>
+        static void DrawStroke(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf fst, Pairf snd, float width,
+            int offsetx = 0, int offsety = 0);
     };
 }
@@ -35,8 +35,11 @@ namespace dr4 {
             return res;
         }
 
-        std::pair<Pairf, Pairf> clipLine(Pairf lineStart, Pairf lineEnd) const{
-            
+        // Clip line to the area covered by the domain pixels, nullopt if the line is completely outside
+        std::optional<std::pair<Pairf, Pairf>> clipLine(Pairf lineStart, Pairf lineEnd) const{
+            Pairf minPoint = { (float)origin.x, (float)origin.y };
+            Pairf maxPoint = { (float)(origin.x + width), (float)(origin.y + height) };
+            return Span2f::Create(minPoint, maxPoint).clipLine(lineStart, lineEnd);
         }
 
         float aspectRatio() const {
@@ -20,7 +20,7 @@ namespace dr4 {
 	template<class METADATA, class RESVALUE>
 	class TypedResult{
 	public:
-		typedef typename RESVALUE result_type_t;
+		typedef RESVALUE result_type_t;
 		bool m_isValid;
 		METADATA m_meta;
 		RESVALUE m_value;
@@ -9,6 +9,7 @@
 #include <dr4/dr4_color.h>
 #include <dr4/dr4_shapes.h>
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <variant>
@@ -35,7 +36,7 @@ namespace dr4 {
 	};
 
 	struct Material2D {
-		float linewidth = 1.0;
+		float linewidth = 1.0; // in pixels, lines wider than a pixel are drawn anti-aliased
 		RGBAFloat32 colorFill;
 		RGBAFloat32 colorLine;
 
@@ -48,16 +49,40 @@ namespace dr4 {
 		static ColorFill CreateDefault() { return {RGBAFloat32::Red()}; }
 	};
 
-	enum class Content2D { Fill, Lines };
+	// Filled polygon. Triangulation is created once when the polygon is added to the scene.
+	struct PolygonFill2D {
+		Polygon2D polygon;
+		size_t material;
+		std::vector<uint32_t> triangles; // Indices to polygon points, three consecutive indices per triangle
+
+		static PolygonFill2D Create(const Polygon2D& polygon, size_t material);
+	};
+
+	// Triangulate polygon. Return indices to polygon points, three consecutive indices per triangle.
+	std::vector<uint32_t> TriangulatePolygon(const Polygon2D& polygon);
+
+	enum class Content2D { Fill, Lines, Polygon };
 
 	struct Graphics2DElement {
 		Content2D content; // refers content type
 		size_t idx; /* Index to content type buffer of type specified by 'content'*/
+		uint64_t version = 0; // scene version of the latest change to the element
 	};
 
 	struct Layer {
 		std::vector<Graphics2DElement> graphics;
 		Blend blend;
+		uint64_t version = 0; // scene version of the latest change to the layer or any of its elements
+	};
+
+	// Change log entry of Scene2D
+	struct Scene2DChange {
+		static constexpr size_t AllLayers = SIZE_MAX;
+		static constexpr size_t AllElements = SIZE_MAX;
+
+		uint64_t version; // scene version after the change
+		size_t layer; // AllLayers if the whole scene changed
+		size_t element; // index to layer graphics, AllElements if the whole layer changed
 	};
 
 	struct ScalarPresentation {
@@ -71,6 +96,23 @@ namespace dr4 {
 		// scene value.
 	};
 
+	class Scene2DIndex;
+
+	// Identity of a Scene2D object. A new id is drawn whenever the scene is constructed, copied or assigned, so
+	// state derived from a scene is not mistaken to belong to another scene, even one at the same address.
+	class Scene2DGeneration {
+	public:
+		Scene2DGeneration() :m_id(Next()) {}
+		Scene2DGeneration(const Scene2DGeneration&) :m_id(Next()) {}
+		Scene2DGeneration& operator=(const Scene2DGeneration&) { m_id = Next(); return *this; }
+
+		uint64_t id() const { return m_id; }
+
+	private:
+		static uint64_t Next();
+		uint64_t m_id;
+	};
+
 	class Scene2D {
 	public:
 
@@ -79,12 +121,39 @@ namespace dr4 {
 
 		std::vector<Line2DCollection> lines;
 		std::vector<ColorFill> colorFills;
+		std::vector<PolygonFill2D> polygons;
 		std::vector<Layer> layers;
 		// todo add ordering of layers ... somewhere
 		std::vector<Material2D> materials;
 
 		ScalarPresentation scalarPresentation = { 1.0f, ScalarPresentation::Unit::Cm };
 
+		// Change tracking. Content may be edited in place, edits are registered with the mark functions
+		// so that renderers can update only the parts of their output affected by the changes.
+		// The log keeps the latest MaxChangeLog changes, older versions are not covered.
+		static constexpr size_t MaxChangeLog = 4096;
+		uint64_t version = 0;
+		std::vector<Scene2DChange> changeLog;
+		uint64_t changeLogStart = 0; // changeLog holds all changes after this version
+		Scene2DGeneration generation;
+
+		// Optional spatial index, see Scene2DIndex. Ignored by renderers once the scene changes after it was built.
+		std::shared_ptr<const Scene2DIndex> index;
+
+		// Element content (points, material, ...) changed, or element was added to the layer
+		void markChanged(size_t layer, size_t element);
+		// Elements were removed or reordered, or the layer blend changed
+		void markLayerChanged(size_t layer);
+		// Layers were added, removed or reordered, or materials used by many elements changed
+		void markAllChanged();
+
+		// Append changes after fromVersion to out. Return false if the change log does not cover fromVersion.
+		bool changesSince(uint64_t fromVersion, std::vector<Scene2DChange>& out) const;
+		// Drop log entries up to and including version
+		void trimChangeLog(uint64_t upToVersion);
+
+	private:
+		void logChange(const Scene2DChange& change);
 	};
 
 
@@ -133,6 +202,17 @@ namespace dr4 {
 			m_scene.layers[layer].graphics.push_back(elem);
 		}
 
+		void add(size_t layer, const PolygonFill2D& polygon) {
+			m_scene.polygons.push_back(polygon);
+			auto idx = lastOf(m_scene.polygons);
+			if (m_scene.polygons[idx].triangles.empty())
+				m_scene.polygons[idx].triangles = TriangulatePolygon(polygon.polygon);
+			Graphics2DElement elem;
+			elem.content = Content2D::Polygon;
+			elem.idx = idx;
+			m_scene.layers[layer].graphics.push_back(elem);
+		}
+
 		Scene2D build() {
 			return m_scene;
 		}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <dr4/dr4_scene2d.h>
+#include <dr4/dr4_span2f.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace dr4 {
+
+	// Indexed content of a scene: a line of a Lines element, a triangle of a Polygon element or a whole Fill element
+	struct Scene2DIndexItem {
+		uint32_t layer;
+		uint32_t element; // index to layer graphics
+		uint32_t item; // line or triangle index within the element, 0 for fills
+	};
+
+	// Uniform grid over the scene space bounds of lines and polygon triangles, used to find the content
+	// visible in a view without visiting the whole scene. Build once for scenes that are viewed more often than
+	// edited and store in Scene2D::index. Renderers use the index only while it is current, edits made to the scene
+	// after building must be registered with Scene2D::markChanged.
+	class Scene2DIndex {
+	public:
+		static std::shared_ptr<const Scene2DIndex> Build(const Scene2D& scene);
+
+		// True if the index was built from this scene object (see Scene2DGeneration) at its current version
+		bool isCurrent(const Scene2D& scene) const;
+
+		// Append indices to items() of the items in the grid cells overlapping span, in painting order without
+		// duplicates. This includes every item whose bounds overlap span. Fills and items too large for the grid
+		// overlap every span.
+		void query(const Span2f& span, std::vector<uint32_t>& out) const;
+
+		const std::vector<Scene2DIndexItem>& items() const { return m_items; }
+
+	private:
+		std::vector<Scene2DIndexItem> m_items; // in painting order
+		std::vector<uint32_t> m_unbounded; // items overlapping every span, fills and items covering many cells
+
+		// Grid cells in row major order, items of cell i are m_cellItems[m_cellStart[i]...m_cellStart[i+1]-1]
+		Span2f m_bounds;
+		size_t m_columns = 0;
+		size_t m_rows = 0;
+		float m_cellWidth = 1.f;
+		float m_cellHeight = 1.f;
+		std::vector<size_t> m_cellStart;
+		std::vector<uint32_t> m_cellItems;
+
+		// Scene state the index was built from
+		uint64_t m_generation = 0;
+		uint64_t m_version = 0;
+		std::vector<size_t> m_layerSizes;
+	};
+}
@@ -11,6 +11,7 @@
 
 #include <stdexcept>
 #include <vector>
+#include <optional>
 
 namespace dr4 {
 	struct Span2f {
@@ -61,8 +62,36 @@ namespace dr4 {
 
 		}
 
-		std::pair<Pairf, Pairf> clipLine(Pairf fst, Pairf snd) const{
+		/** Clip line segment to this span (Liang-Barsky). Return nullopt if no part of the segment is inside.*/
+		std::optional<std::pair<Pairf, Pairf>> clipLine(Pairf fst, Pairf snd) const{
+			const float dx = snd.x - fst.x;
+			const float dy = snd.y - fst.y;
+			float t0 = 0.f;
+			float t1 = 1.f;
 
+			// Each boundary limits the parameter range from one side, p * t <= q
+			const float p[4] = { -dx, dx, -dy, dy };
+			const float q[4] = { fst.x - x.min, x.max - fst.x, fst.y - y.min, y.max - fst.y };
+			for (int i = 0; i < 4; i++) {
+				if (p[i] == 0.f) {
+					if (q[i] < 0.f)
+						return std::nullopt; // parallel to and outside the boundary
+					continue;
+				}
+				float t = q[i] / p[i];
+				if (p[i] < 0.f) {
+					if (t > t1) return std::nullopt;
+					if (t > t0) t0 = t;
+				}
+				else {
+					if (t < t0) return std::nullopt;
+					if (t < t1) t1 = t;
+				}
+			}
+
+			Pairf clippedFst = (t0 > 0.f) ? Pairf{ fst.x + t0 * dx, fst.y + t0 * dy } : fst;
+			Pairf clippedSnd = (t1 < 1.f) ? Pairf{ fst.x + t1 * dx, fst.y + t1 * dy } : snd;
+			return std::make_pair(clippedFst, clippedSnd);
 		}
 
 		// Return corners. 
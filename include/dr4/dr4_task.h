@@ -4,10 +4,32 @@
 #include <thread>
 #include <memory>
 #include <atomic>
+#include <cstdint>
+#include <functional>
 
 
 namespace dr4 {
 
+	// Monotonic clock of profile timestamps, in nanoseconds
+	int64_t ProfileClockNs();
+
+	// Measurements of a task run. Recorded only for tasks with profiling enabled.
+	struct TaskProfile {
+		int64_t startNs = 0; // ProfileClockNs at start and end of doTask
+		int64_t endNs = 0;
+		uint64_t threadId = 0; // hash of the thread that ran the task
+		// Counters updated by the task itself
+		uint64_t primitives = 0;
+		uint64_t pixels = 0;
+		uint64_t bytesAllocated = 0;
+	};
+
+	// Named measurement of work done outside of tasks, e.g. a step of a rasterizer
+	struct ProfileEvent {
+		const char* name;
+		TaskProfile profile;
+	};
+
 	class ITask {
 	// Internal state		
 		std::atomic<bool> m_done = false;
@@ -15,14 +37,54 @@ namespace dr4 {
 			m_done = true;
 		}
 
+		bool m_profiling = false;
+		TaskProfile m_profile;
+		void run();
+
+		// Dependencies: tasks started when this one is done, and predecessors not yet done during a run.
+		// The first successors are stored in the task, which covers a draw task followed by a composite and a
+		// future completion without allocating.
+		static const size_t InlineSuccessors = 2;
+		ITask* m_inlineSuccessors[InlineSuccessors] = {};
+		std::vector<ITask*> m_moreSuccessors;
+		size_t m_successorCount = 0;
+		size_t m_predecessorCount = 0;
+		std::atomic<size_t> m_waitingFor = 0;
+
 		friend class SequentialExecutor;
-		friend class ParallelExecutor;
+		friend class ThreadPool;
 
 	public:
 		bool isDone() const {
 			return m_done;
 		}
 
+		// When enabled, executors record the time and thread of the task and doTask may update the counters of
+		// profile(). Disabled tasks cost a single branch.
+		void setProfiling(bool enabled) { m_profiling = enabled; }
+		bool profiling() const { return m_profiling; }
+		TaskProfile& profile() { return m_profile; }
+		const TaskProfile& profile() const { return m_profile; }
+
+		// Start this task only after predecessor is done. Both tasks must be run by the same runBlock or submit
+		// call, which then runs each task as soon as all of its predecessors are done.
+		void addPredecessor(ITask& predecessor) {
+			if (predecessor.m_successorCount < InlineSuccessors)
+				predecessor.m_inlineSuccessors[predecessor.m_successorCount] = this;
+			else
+				predecessor.m_moreSuccessors.push_back(this);
+			predecessor.m_successorCount++;
+			m_predecessorCount++;
+		}
+		size_t predecessorCount() const { return m_predecessorCount; }
+		size_t successorCount() const { return m_successorCount; }
+		ITask* successor(size_t i) const {
+			return i < InlineSuccessors ? m_inlineSuccessors[i] : m_moreSuccessors[i - InlineSuccessors];
+		}
+
+		// Name of the task in profile output
+		virtual const char* name() const { return "Task"; }
+
 	// Implementation interface
 	public:
 		virtual ~ITask() {}
@@ -34,13 +96,50 @@ namespace dr4 {
 
 	};
 
+	class ThreadPool;
+	class TaskFutureState;
+
+	// Handle to tasks submitted without waiting for them. Copies refer to the same tasks.
+	class TaskFuture {
+	public:
+		TaskFuture() {}
+
+		bool valid() const { return (bool)m_state; }
+		// True when all tasks are done and the continuations attached before that have been called
+		bool isReady() const;
+		// Block until ready. The waiting thread runs queued tasks of the pool meanwhile.
+		void wait() const;
+		// Call fun when all tasks are done, on the thread finishing the last one. If the tasks are already done,
+		// fun is called at once on the calling thread.
+		void then(std::function<void()> fun) const;
+
+	private:
+		friend class ParallelExecutor;
+		friend class SequentialExecutor;
+		explicit TaskFuture(std::shared_ptr<TaskFutureState> state) :m_state(state) {}
+		std::shared_ptr<TaskFutureState> m_state;
+	};
+
+	// Executors run a collection of tasks and return when all are done, or with submit return at once with a
+	// future of the tasks. Tasks without predecessors are started at once, others as soon as their predecessors
+	// are done. A task is run once.
+
+	// Runs tasks on a thread pool, by default the global pool of dr4_threadpool.h
 	class ParallelExecutor {
 	public:
-	 void runBlock(ITask::Collection& tasks);
+		ParallelExecutor();
+		explicit ParallelExecutor(ThreadPool& pool) :m_pool(&pool) {}
+		void runBlock(ITask::Collection& tasks);
+		TaskFuture submit(ITask::Collection tasks);
+
+	private:
+		ThreadPool* m_pool;
 	};
 	
 	class SequentialExecutor {
 	public:
 		void runBlock(ITask::Collection& tasks);
+		// Runs the tasks before returning, the future is ready
+		TaskFuture submit(ITask::Collection tasks);
 	};
 }
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <dr4/dr4_task.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace dr4 {
+
+	// Bump allocator for the tasks of a frame. create places a task and its shared_ptr control block in the arena,
+	// so creating a task costs a pointer bump instead of a heap allocation. reset reuses the memory once the tasks
+	// created since the previous reset are freed. Tasks may outlive the arena, the memory is then released with
+	// the last of them. Create tasks from one thread at a time, tasks may be freed on any thread.
+	class TaskArena {
+		// Memory blocks, reference counted by the arena and the allocators in the control blocks of live tasks
+		struct Blocks {
+			std::atomic<size_t> refs = 1;
+			std::vector<std::unique_ptr<uint8_t[]>> blocks;
+			std::vector<size_t> blockSizes;
+			size_t block = 0; // block being filled
+			size_t offset = 0;
+			size_t blockSize;
+			size_t heapAllocations = 0;
+
+			explicit Blocks(size_t size) :blockSize(size) {}
+			void* allocate(size_t bytes, size_t alignment);
+		};
+
+		static void Retain(Blocks* blocks) { blocks->refs++; }
+		static void Release(Blocks* blocks) {
+			if (--blocks->refs == 0)
+				delete blocks;
+		}
+
+	public:
+		// Allocator of arena memory. Deallocation is a no-op, the memory is reused or released as a whole.
+		template<class T>
+		class Allocator {
+		public:
+			typedef T value_type;
+
+			explicit Allocator(Blocks* blocks) :m_blocks(blocks) { Retain(m_blocks); }
+			Allocator(const Allocator& other) :m_blocks(other.m_blocks) { Retain(m_blocks); }
+			template<class U>
+			Allocator(const Allocator<U>& other) : m_blocks(other.m_blocks) { Retain(m_blocks); }
+			~Allocator() { Release(m_blocks); }
+			Allocator& operator=(const Allocator&) = delete;
+
+			T* allocate(size_t count) { return (T*)m_blocks->allocate(count * sizeof(T), alignof(T)); }
+			void deallocate(T*, size_t) {}
+
+			template<class U> bool operator==(const Allocator<U>& other) const { return m_blocks == other.m_blocks; }
+			template<class U> bool operator!=(const Allocator<U>& other) const { return m_blocks != other.m_blocks; }
+
+		private:
+			template<class U> friend class Allocator;
+			Blocks* m_blocks;
+		};
+
+		explicit TaskArena(size_t blockSize = 64 * 1024) :m_blocks(new Blocks(blockSize)) {}
+		~TaskArena() { Release(m_blocks); }
+
+		TaskArena(const TaskArena&) = delete;
+		TaskArena& operator=(const TaskArena&) = delete;
+
+		template<class T, class... Args>
+		std::shared_ptr<T> create(Args&&... args) {
+			return std::allocate_shared<T>(Allocator<T>(m_blocks), std::forward<Args>(args)...);
+		}
+
+		// Start a new frame. The memory is reused if no task created from the arena is alive, otherwise it is left
+		// to the remaining tasks and new memory is allocated.
+		void reset();
+
+		// Memory blocks allocated by the arena since it was constructed
+		size_t heapAllocations() const { return m_retiredHeapAllocations + m_blocks->heapAllocations; }
+
+	private:
+		Blocks* m_blocks;
+		size_t m_retiredHeapAllocations = 0;
+	};
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <dr4/dr4_task.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dr4 {
+
+	struct ThreadPoolConfig {
+		static constexpr size_t Auto = SIZE_MAX;
+		// Background threads, Auto uses one less than the hardware concurrency. Threads waiting for their work to
+		// complete run queued tasks too, so the waiting thread makes up the rest. With zero workers tasks run on the
+		// waiting threads only.
+		size_t workers = Auto;
+		// Pin worker i to logical processor i modulo the processor count
+		bool pinThreads = false;
+	};
+
+	// Tasks submitted to a pool and waited for together
+	class TaskGroup {
+	public:
+		bool isDone() const { return m_pending == 0; }
+
+	private:
+		friend class ThreadPool;
+		std::atomic<size_t> m_pending = 0;
+		std::shared_ptr<void> m_owner; // held by the pool until the group is done, see submit
+	};
+
+	// Persistent threads running tasks from per-thread queues. A thread takes the most recent task of its own queue
+	// and, when that is empty, steals the oldest task of another queue. Tasks submitted from a worker go to its own
+	// queue, tasks submitted from other threads are spread over all queues.
+	class ThreadPool {
+	public:
+		explicit ThreadPool(ThreadPoolConfig config = ThreadPoolConfig());
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Pool shared by the library, started on first use
+		static ThreadPool& Global();
+		// Set the configuration of the global pool. Return false if the pool is already running.
+		static bool ConfigureGlobal(ThreadPoolConfig config);
+
+		size_t workerCount() const { return m_threads.size(); }
+
+		// Queue tasks to run as part of group. Tasks with predecessors are queued when their predecessors are done.
+		// Tasks must stay alive until the group is done.
+		void submit(ITask* task, TaskGroup& group);
+		void submit(ITask::Collection& tasks, TaskGroup& group);
+		// Submit with the pool holding owner until group is done. The group and tasks may then be part of owner,
+		// and owner is released by the thread finishing the last task when nothing else refers to it.
+		void submit(ITask::Collection& tasks, TaskGroup& group, std::shared_ptr<void> owner);
+
+		// Run queued tasks until all tasks of group are done. Safe to call from within a task.
+		void wait(TaskGroup& group);
+
+		// Run all tasks and return when they are done
+		void runBlock(ITask::Collection& tasks);
+
+		// Call fun(i) for i in 0...count-1 in parallel and return when all calls are done
+		void parallelFor(size_t count, const std::function<void(size_t)>& fun);
+
+	private:
+		struct Job {
+			ITask* task;
+			TaskGroup* group;
+		};
+
+		struct alignas(64) Queue {
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		void submitTasks(size_t count, const std::function<ITask*(size_t)>& task, TaskGroup& group,
+			std::shared_ptr<void> owner = nullptr);
+		void push(const Job& job, size_t queueIdx);
+		bool tryRunOne(size_t ownQueue);
+		void runJob(const Job& job);
+		void workerLoop(size_t workerIdx);
+		size_t submitQueue();
+
+		std::vector<std::unique_ptr<Queue>> m_queues; // one per worker
+		std::vector<std::thread> m_threads;
+		std::atomic<size_t> m_queued = 0;
+		std::atomic<size_t> m_nextQueue = 0;
+		std::mutex m_sleepMutex;
+		std::condition_variable m_wake;
+		bool m_stop = false;
+	};
+}
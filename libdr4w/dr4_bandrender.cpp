@@ -0,0 +1,225 @@
+#include <dr4/dr4_bandrender.h>
+#include <dr4/dr4_framepipeline.h>
+#include <dr4/dr4_io.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+	// Frame rows firstRow...firstRow+bandHeight-1, counted from the top. The band keeps the raster mapping of the
+	// frame and is placed by an integer row offset, like render tiles, so its pixels match a full frame render.
+	dr4::RasterConfig2D BandRasterConfig(const dr4::RasterConfig2D& config, size_t firstRow, size_t bandHeight) {
+		dr4::RasterConfig2D band = config;
+		// Raster y is up
+		band.bufferOrigin.y = config.bufferOrigin.y + config.m_rasterDomain.height - (firstRow + bandHeight);
+		return band;
+	}
+
+	uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t size) {
+		static const std::array<uint32_t, 256> table = []() {
+			std::array<uint32_t, 256> res;
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t c = i;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				res[i] = c;
+			}
+			return res;
+		}();
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	void AppendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+		out.push_back((uint8_t)(value >> 24));
+		out.push_back((uint8_t)(value >> 16));
+		out.push_back((uint8_t)(value >> 8));
+		out.push_back((uint8_t)value);
+	}
+}
+
+std::string dr4::RenderBands(RasterConfig2D config, const Scene2D& scene, BandOutput output, BandRenderConfig bandConfig) {
+	const size_t width = config.m_rasterDomain.width;
+	const size_t height = config.m_rasterDomain.height;
+	if (width == 0 || height == 0)
+		return "RenderBands:Empty raster domain";
+	const size_t bandHeight = std::clamp<size_t>(bandConfig.bandHeight, 1, height);
+
+	// A single worker outputs the bands in submission order
+	FramePipelineConfig pipelineConfig;
+	pipelineConfig.depth = bandConfig.depth;
+	pipelineConfig.workers = 1;
+	pipelineConfig.rasterizer = bandConfig.rasterizer;
+
+	std::mutex errorMutex;
+	std::string error;
+	auto failed = [&]() {
+		std::lock_guard<std::mutex> lock(errorMutex);
+		return !error.empty();
+	};
+
+	{
+		FramePipeline pipeline((unsigned)width, (unsigned)bandHeight, pipelineConfig);
+		for (size_t firstRow = 0; firstRow < height && !failed(); firstRow += bandHeight) {
+			const size_t rowCount = std::min(bandHeight, height - firstRow);
+			// The last band is rendered aligned to the bottom of the frame, overlapping the previous band
+			const size_t bandRow = std::min(firstRow, height - bandHeight);
+			const size_t skipRows = firstRow - bandRow;
+			pipeline.submit(BandRasterConfig(config, bandRow, bandHeight), scene,
+				[&, firstRow, rowCount, skipRows](size_t, const ImageRGBA8SRGB& band) {
+				if (failed())
+					return;
+				std::string res = output(firstRow, rowCount, band.data() + skipRows * width);
+				if (!res.empty()) {
+					std::lock_guard<std::mutex> lock(errorMutex);
+					error = res;
+				}
+			});
+		}
+	}
+	return error;
+}
+
+std::string dr4::RenderBandsToPng(RasterConfig2D config, const Scene2D& scene, const std::string& path,
+	BandRenderConfig bandConfig) {
+	PngStreamWriter writer;
+	std::string res = writer.open(path, config.m_rasterDomain.width, config.m_rasterDomain.height);
+	if (!res.empty())
+		return res;
+	res = RenderBands(config, scene, [&writer](size_t, size_t rowCount, const SRGBA* rows) {
+		return writer.writeRows(rows, rowCount);
+	}, bandConfig);
+	if (!res.empty())
+		return res;
+	return writer.close();
+}
+
+//
+// PngStreamWriter
+//
+
+dr4::PngStreamWriter::~PngStreamWriter() {
+	if (m_file.is_open())
+		m_file.close();
+}
+
+void dr4::PngStreamWriter::writeChunk(const char* type, const uint8_t* data, size_t size) {
+	std::vector<uint8_t> header;
+	AppendBigEndian(header, (uint32_t)size);
+	header.insert(header.end(), type, type + 4);
+	uint32_t crc = Crc32(0, header.data() + 4, 4);
+	crc = Crc32(crc, data, size);
+	std::vector<uint8_t> footer;
+	AppendBigEndian(footer, crc);
+
+	m_file.write((const char*)header.data(), header.size());
+	m_file.write((const char*)data, size);
+	m_file.write((const char*)footer.data(), footer.size());
+}
+
+std::string dr4::PngStreamWriter::open(const std::string& path, size_t width, size_t height) {
+	if (width == 0 || height == 0 || width > 0x7fffffff || height > 0x7fffffff)
+		return "PngStreamWriter:Invalid dimensions";
+	auto pathres = preparePathForWriting(path.c_str());
+	if (!pathres.empty())
+		return pathres;
+
+	m_file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+	if (!m_file.is_open())
+		return std::string("PngStreamWriter:Could not open file ") + path;
+	m_path = path;
+	m_width = width;
+	m_height = height;
+	m_rowsWritten = 0;
+	m_adlerA = 1;
+	m_adlerB = 0;
+
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	m_file.write((const char*)signature, sizeof(signature));
+
+	// 8 bit RGBA, no interlace
+	std::vector<uint8_t> ihdr;
+	AppendBigEndian(ihdr, (uint32_t)width);
+	AppendBigEndian(ihdr, (uint32_t)height);
+	ihdr.insert(ihdr.end(), { 8, 6, 0, 0, 0 });
+	writeChunk("IHDR", ihdr.data(), ihdr.size());
+
+	// zlib header: deflate, 32K window, no preset dictionary
+	const uint8_t zlibHeader[] = { 0x78, 0x01 };
+	writeChunk("IDAT", zlibHeader, sizeof(zlibHeader));
+
+	if (!m_file)
+		return std::string("PngStreamWriter:Could not write to ") + path;
+	return "";
+}
+
+std::string dr4::PngStreamWriter::writeRows(const SRGBA* rows, size_t rowCount) {
+	if (!m_file.is_open())
+		return "PngStreamWriter:File is not open";
+	if (m_rowsWritten + rowCount > m_height)
+		return "PngStreamWriter:Too many rows";
+
+	// Scanlines with filter type None
+	const size_t rowBytes = 4 * m_width;
+	std::vector<uint8_t> raw(rowCount * (rowBytes + 1));
+	for (size_t y = 0; y < rowCount; y++) {
+		uint8_t* line = raw.data() + y * (rowBytes + 1);
+		line[0] = 0;
+		memcpy(line + 1, rows + y * m_width, rowBytes);
+	}
+
+	// Adler-32 of the uncompressed stream, reduced before the sums can overflow
+	const size_t nmax = 5552;
+	for (size_t begin = 0; begin < raw.size(); begin += nmax) {
+		const size_t end = std::min(raw.size(), begin + nmax);
+		for (size_t i = begin; i < end; i++) {
+			m_adlerA += raw[i];
+			m_adlerB += m_adlerA;
+		}
+		m_adlerA %= 65521;
+		m_adlerB %= 65521;
+	}
+
+	// Non-final stored blocks of at most 65535 bytes
+	const size_t maxBlock = 65535;
+	m_chunk.clear();
+	m_chunk.reserve(raw.size() + (raw.size() / maxBlock + 1) * 5);
+	for (size_t begin = 0; begin < raw.size(); begin += maxBlock) {
+		const uint16_t len = (uint16_t)std::min(maxBlock, raw.size() - begin);
+		const uint16_t nlen = (uint16_t)~len;
+		m_chunk.insert(m_chunk.end(), { 0, (uint8_t)len, (uint8_t)(len >> 8), (uint8_t)nlen, (uint8_t)(nlen >> 8) });
+		m_chunk.insert(m_chunk.end(), raw.begin() + begin, raw.begin() + begin + len);
+	}
+	writeChunk("IDAT", m_chunk.data(), m_chunk.size());
+	m_rowsWritten += rowCount;
+
+	if (!m_file)
+		return std::string("PngStreamWriter:Could not write to ") + m_path;
+	return "";
+}
+
+std::string dr4::PngStreamWriter::close() {
+	if (!m_file.is_open())
+		return "PngStreamWriter:File is not open";
+	if (m_rowsWritten != m_height) {
+		m_file.close();
+		return "PngStreamWriter:Not all rows were written";
+	}
+
+	// Empty final stored block and the checksum end the zlib stream
+	std::vector<uint8_t> tail = { 1, 0, 0, 0xff, 0xff };
+	AppendBigEndian(tail, (m_adlerB << 16) | m_adlerA);
+	writeChunk("IDAT", tail.data(), tail.size());
+	writeChunk("IEND", nullptr, 0);
+
+	const bool ok = (bool)m_file;
+	m_file.close();
+	if (!ok)
+		return std::string("PngStreamWriter:Could not write to ") + m_path;
+	return "";
+}
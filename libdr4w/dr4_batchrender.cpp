@@ -0,0 +1,262 @@
+#include <dr4/dr4_batchrender.h>
+#include <dr4/dr4_json_parser.h>
+#include <dr4/dr4_image.h>
+#include <dr4/dr4_io.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+	double MillisecondsSince(int64_t startNs) {
+		return 1e-6 * (double)(dr4::ProfileClockNs() - startNs);
+	}
+
+	// Idle rasterizers by image size. A worker holds at most one rasterizer, and at most one idle rasterizer
+	// per worker is kept, so the render buffers of the batch are bounded by the worker count.
+	class RasterizerPool {
+	public:
+		RasterizerPool(dr4::RasterizerConfig config, size_t maxIdle) :m_config(config), m_maxIdle(maxIdle) {}
+
+		std::shared_ptr<dr4::IRasterizer> acquire(unsigned width, unsigned height) {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto& idle = m_idle[{width, height}];
+				if (!idle.empty()) {
+					auto rasterizer = idle.back();
+					idle.pop_back();
+					m_idleCount--;
+					return rasterizer;
+				}
+				m_created++;
+			}
+			return dr4::CreateRasterizer(width, height, m_config);
+		}
+
+		void release(unsigned width, unsigned height, std::shared_ptr<dr4::IRasterizer> rasterizer) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_idleCount >= m_maxIdle) {
+				// Drop an idle rasterizer of another size, or this one if there is none
+				auto other = std::find_if(m_idle.begin(), m_idle.end(), [&](const auto& entry) {
+					return !entry.second.empty() && entry.first != std::make_pair(width, height); });
+				if (other == m_idle.end())
+					return;
+				other->second.pop_back();
+				m_idleCount--;
+			}
+			m_idle[{width, height}].push_back(rasterizer);
+			m_idleCount++;
+		}
+
+		size_t created() const { return m_created; }
+
+	private:
+		dr4::RasterizerConfig m_config;
+		size_t m_maxIdle;
+		std::mutex m_mutex;
+		std::map<std::pair<unsigned, unsigned>, std::vector<std::shared_ptr<dr4::IRasterizer>>> m_idle;
+		size_t m_idleCount = 0;
+		size_t m_created = 0;
+	};
+
+	dr4::RasterConfig2D JobRasterConfig(const dr4::BatchJob& job) {
+		using namespace dr4;
+		RasterDomain rasterDomain = RasterDomain::Create(job.width, job.height);
+		float aspect = rasterDomain.aspectRatio();
+		SceneDomain sceneDomain = { job.view ? *job.view : Span2f::Create({-0.5f * aspect, -0.5f}, {0.5f * aspect, 0.5f}) };
+		return RasterConfig2D::Create(rasterDomain, sceneDomain);
+	}
+
+	void RunJobStages(const dr4::BatchJob& job, RasterizerPool& pool, dr4::BatchJobResult& result) {
+		using namespace dr4;
+		if (job.width == 0 || job.height == 0) {
+			result.error = "RenderBatch:Empty image size";
+			return;
+		}
+
+		int64_t start = ProfileClockNs();
+		auto file = readFileFromPathToString(job.scenePath);
+		result.readMs = MillisecondsSince(start);
+		if (!file.second.empty()) {
+			result.error = file.second;
+			return;
+		}
+
+		start = ProfileClockNs();
+		Scene2D scene;
+		{
+			JsonResult json = CreateJsonFromString(file.first);
+			file.first.clear();
+			if (!json) {
+				result.error = std::string("RenderBatch:") + json.metaToString() + " in " + job.scenePath;
+				return;
+			}
+			JsonParser parser;
+			if (!parser.fromJson(json.value(), scene)) {
+				result.error = std::string("RenderBatch:Could not read scene ") + job.scenePath;
+				return;
+			}
+		}
+		result.parseMs = MillisecondsSince(start);
+
+		// The render buffer returns to the pool before encoding, so it can serve the next job meanwhile
+		start = ProfileClockNs();
+		ImageRGBA8SRGB image = [&]() {
+			auto rasterizer = pool.acquire(job.width, job.height);
+			FrameTasks tasks;
+			rasterizer->draw2D(JobRasterConfig(job), scene, tasks);
+			ParallelExecutor executor;
+			executor.runBlock(tasks.tasks);
+			rasterizer->applyResult(tasks);
+			ImageRGBA8SRGB srgb = rasterizer->getColorAsSRGB();
+			pool.release(job.width, job.height, rasterizer);
+			return srgb;
+		}();
+		scene = Scene2D();
+		result.renderMs = MillisecondsSince(start);
+
+		start = ProfileClockNs();
+		result.error = writeImageAsPng(image, job.outputPath);
+		result.encodeMs = MillisecondsSince(start);
+	}
+
+	// A job that throws, e.g. on a failed allocation for a huge image, fails alone and the batch continues
+	void RunJob(const dr4::BatchJob& job, RasterizerPool& pool, dr4::BatchJobResult& result) {
+		try {
+			RunJobStages(job, pool, result);
+		}
+		catch (const std::exception& e) {
+			result.error = std::string("RenderBatch:") + e.what() + " in " + job.scenePath;
+		}
+		catch (...) {
+			result.error = std::string("RenderBatch:Unknown error in ") + job.scenePath;
+		}
+	}
+
+	// Image dimension of key in object, or fallback if there is none. Return false if the value is not an
+	// unsigned integer.
+	bool ReadImageSize(const nlohmann::json& object, const char* key, unsigned fallback, unsigned& size) {
+		if (!object.contains(key)) {
+			size = fallback;
+			return true;
+		}
+		const auto& value = object[key];
+		if (!value.is_number_unsigned() || value.get<uint64_t>() > std::numeric_limits<unsigned>::max())
+			return false;
+		size = value.get<unsigned>();
+		return true;
+	}
+}
+
+dr4::BatchReport dr4::RenderBatch(const std::vector<BatchJob>& jobs, BatchRenderConfig config) {
+	BatchReport report;
+	report.results.resize(jobs.size());
+	size_t workers = config.workers ? config.workers : std::max(1u, std::thread::hardware_concurrency());
+	report.workers = std::max<size_t>(1, std::min(workers, jobs.size()));
+
+	RasterizerPool pool(config.rasterizer, report.workers);
+	std::atomic<size_t> nextJob = 0;
+	const int64_t batchStart = ProfileClockNs();
+
+	auto worker = [&](size_t workerIdx) {
+		for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+			BatchJobResult& result = report.results[i];
+			result.worker = workerIdx;
+			result.startMs = MillisecondsSince(batchStart);
+			RunJob(jobs[i], pool, result);
+			if (config.progress)
+				config.progress(i, result);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < report.workers; i++)
+		threads.emplace_back(worker, i);
+	worker(0);
+	for (auto& t : threads)
+		t.join();
+
+	report.wallMs = MillisecondsSince(batchStart);
+	report.rasterizersCreated = pool.created();
+	for (const auto& result : report.results) {
+		if (!result.error.empty())
+			report.failed++;
+	}
+	return report;
+}
+
+std::string dr4::ReadBatchManifest(const std::string& path, std::vector<BatchJob>& jobs) {
+	using json = nlohmann::json;
+	auto file = readFileFromPathToString(path);
+	if (!file.second.empty())
+		return file.second;
+
+	json manifest = json::parse(file.first, nullptr, false);
+	if (manifest.is_discarded() || !manifest.is_object() || !manifest.contains("jobs") || !manifest["jobs"].is_array())
+		return std::string("ReadBatchManifest:Expected an object with a jobs array in ") + path;
+
+	const std::filesystem::path base = std::filesystem::path(path).parent_path();
+	auto resolve = [&base](const std::string& p) {
+		std::filesystem::path fp(p);
+		return (fp.is_relative() ? base / fp : fp).string();
+	};
+
+	unsigned defaultWidth = 0;
+	unsigned defaultHeight = 0;
+	if (!ReadImageSize(manifest, "width", 0, defaultWidth) || !ReadImageSize(manifest, "height", 0, defaultHeight))
+		return std::string("ReadBatchManifest:Expected width and height as unsigned integers in ") + path;
+	std::vector<BatchJob> res;
+	for (const auto& entry : manifest["jobs"]) {
+		const std::string jobName = std::string("job ") + std::to_string(res.size());
+		if (!entry.is_object() || !entry.contains("scene") || !entry.contains("output")
+			|| !entry["scene"].is_string() || !entry["output"].is_string())
+			return std::string("ReadBatchManifest:Expected scene and output paths in ") + jobName;
+
+		BatchJob job;
+		job.scenePath = resolve(entry["scene"].get<std::string>());
+		job.outputPath = resolve(entry["output"].get<std::string>());
+		if (!ReadImageSize(entry, "width", defaultWidth, job.width) || !ReadImageSize(entry, "height", defaultHeight, job.height))
+			return std::string("ReadBatchManifest:Expected width and height as unsigned integers in ") + jobName;
+		if (job.width == 0 || job.height == 0)
+			return std::string("ReadBatchManifest:No image size in ") + jobName;
+
+		if (entry.contains("view")) {
+			const auto& view = entry["view"];
+			if (!view.is_array() || view.size() != 4 || !std::all_of(view.begin(), view.end(), [](const json& v) { return v.is_number(); }))
+				return std::string("ReadBatchManifest:Expected view as [xmin, ymin, xmax, ymax] in ") + jobName;
+			job.view = Span2f::Create({ view[0].get<float>(), view[1].get<float>() }, { view[2].get<float>(), view[3].get<float>() });
+		}
+		res.push_back(job);
+	}
+	jobs = res;
+	return "";
+}
+
+std::string dr4::BatchReportJson(const std::vector<BatchJob>& jobs, const BatchReport& report) {
+	using json = nlohmann::json;
+	json stageMs = { {"read", 0.0}, {"parse", 0.0}, {"render", 0.0}, {"encode", 0.0} };
+	json results = json::array();
+	for (size_t i = 0; i < report.results.size() && i < jobs.size(); i++) {
+		const auto& r = report.results[i];
+		stageMs["read"] = stageMs["read"].get<double>() + r.readMs;
+		stageMs["parse"] = stageMs["parse"].get<double>() + r.parseMs;
+		stageMs["render"] = stageMs["render"].get<double>() + r.renderMs;
+		stageMs["encode"] = stageMs["encode"].get<double>() + r.encodeMs;
+		results.push_back({
+			{"scene", jobs[i].scenePath}, {"output", jobs[i].outputPath},
+			{"width", jobs[i].width}, {"height", jobs[i].height}, {"worker", r.worker},
+			{"startMs", r.startMs}, {"readMs", r.readMs}, {"parseMs", r.parseMs},
+			{"renderMs", r.renderMs}, {"encodeMs", r.encodeMs}, {"error", r.error} });
+	}
+	json out = {
+		{"jobs", report.results.size()}, {"failed", report.failed}, {"workers", report.workers},
+		{"rasterizersCreated", report.rasterizersCreated}, {"wallMs", report.wallMs},
+		{"jobsPerSecond", report.jobsPerSecond()}, {"stageMs", stageMs}, {"results", results} };
+	return out.dump(1);
+}
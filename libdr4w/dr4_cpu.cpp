@@ -0,0 +1,76 @@
+#include <dr4/dr4_cpu.h>
+
+#if defined(DR4_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#include <cstdint>
+
+namespace {
+#if defined(DR4_X86)
+	void cpuid(int leaf, int subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+		int r[4];
+		__cpuidex(r, leaf, subleaf);
+		for (int i = 0; i < 4; i++) regs[i] = (uint32_t)r[i];
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	// Extended register state enabled by the operating system
+	uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((uint64_t)edx << 32) | eax;
+#endif
+	}
+#endif
+
+	dr4::CpuFeatures detectFeatures() {
+		dr4::CpuFeatures features;
+#if defined(DR4_X86)
+		uint32_t regs[4];
+		cpuid(0, 0, regs);
+		uint32_t maxLeaf = regs[0];
+
+		cpuid(1, 0, regs);
+		features.sse2 = (regs[3] & (1u << 26)) != 0;
+		features.sse41 = (regs[2] & (1u << 19)) != 0;
+		bool osxsave = (regs[2] & (1u << 27)) != 0;
+		bool avx = (regs[2] & (1u << 28)) != 0;
+		bool f16c = (regs[2] & (1u << 29)) != 0;
+
+		// AVX state (xmm and ymm registers) must be saved by the operating system
+		bool osAvx = osxsave && ((xgetbv0() & 0x6) == 0x6);
+		features.f16c = avx && osAvx && f16c;
+
+		if (maxLeaf >= 7) {
+			cpuid(7, 0, regs);
+			features.avx2 = avx && osAvx && (regs[1] & (1u << 5)) != 0;
+		}
+#endif
+		return features;
+	}
+}
+
+const dr4::CpuFeatures& dr4::CpuFeatures::Get() {
+	static const CpuFeatures features = detectFeatures();
+	return features;
+}
+
+const char* dr4::SimdLevelToString(SimdLevel level) {
+	switch (level) {
+	case SimdLevel::Scalar: return "Scalar";
+	case SimdLevel::SSE2: return "SSE2";
+	case SimdLevel::AVX2: return "AVX2";
+	}
+	return "<Unknown>";
+}
@@ -0,0 +1,99 @@
+#include <dr4/dr4_framepipeline.h>
+#include <dr4/dr4_task.h>
+
+#include <algorithm>
+
+dr4::FramePipeline::FramePipeline(unsigned width, unsigned height, FramePipelineConfig config) {
+	const size_t depth = std::max<size_t>(1, config.depth);
+	m_slots.resize(depth);
+	for (auto& slot : m_slots)
+		slot.rasterizer = CreateRasterizer(width, height, config.rasterizer);
+
+	const size_t workers = std::max<size_t>(1, std::min(config.workers, depth));
+	for (size_t i = 0; i < workers; i++)
+		m_workers.emplace_back([this]() { workerLoop(); });
+}
+
+dr4::FramePipeline::~FramePipeline() {
+	finish();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_jobQueued.notify_all();
+	for (auto& worker : m_workers)
+		worker.join();
+}
+
+size_t dr4::FramePipeline::submit(RasterConfig2D config, const Scene2D& scene, FrameOutput output) {
+	// Slots are used round robin, so frames free up in submission order when there is a single worker
+	size_t slotIdx;
+	size_t frameIndex;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_slotFreed.wait(lock, [this]() {
+			return std::any_of(m_slots.begin(), m_slots.end(), [](const Slot& s) { return !s.busy; });
+		});
+		slotIdx = m_nextSlot;
+		while (m_slots[slotIdx].busy)
+			slotIdx = (slotIdx + 1) % m_slots.size();
+		m_nextSlot = (slotIdx + 1) % m_slots.size();
+		m_slots[slotIdx].busy = true;
+		m_pending++;
+		frameIndex = m_nextFrame++;
+	}
+
+	// The slot is owned by this thread until queued
+	auto& rasterizer = *m_slots[slotIdx].rasterizer;
+	FrameTasks tasks;
+	ParallelExecutor executor;
+	rasterizer.draw2D(config, scene, tasks);
+	executor.runBlock(tasks.tasks);
+	rasterizer.applyResult(tasks);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back({ slotIdx, frameIndex, std::move(output) });
+	}
+	m_jobQueued.notify_one();
+	return frameIndex;
+}
+
+void dr4::FramePipeline::finish() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_slotFreed.wait(lock, [this]() { return m_pending == 0; });
+}
+
+void dr4::FramePipeline::workerLoop() {
+	for (;;) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobQueued.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+			if (m_queue.empty())
+				return;
+			job = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+
+		// The render buffer is released as soon as it has been converted, output runs on the converted image
+		ImageRGBA8SRGB image = m_slots[job.slot].rasterizer->getColorAsSRGB();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_slots[job.slot].busy = false;
+		}
+		m_slotFreed.notify_all();
+
+		if (job.output)
+			job.output(job.frameIndex, image);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending--;
+		}
+		m_slotFreed.notify_all();
+	}
+}
+
+dr4::FrameOutput dr4::FramePipeline::WritePng(const std::string& path) {
+	return [path](size_t, const ImageRGBA8SRGB& image) { writeImageAsPng(image, path); };
+}
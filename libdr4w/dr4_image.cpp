@@ -6,8 +6,15 @@
 
 #include <dr4/dr4_image.h>
 #include <dr4/dr4_io.h>
+#include <dr4/dr4_cpu.h>
+#include <dr4/dr4_parallel.h>
 
 #include <filesystem>
+#include <algorithm>
+
+#if defined(DR4_X86)
+#include <immintrin.h>
+#endif
 
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
 #include <stb/stb_image_resize.h>
@@ -62,23 +69,151 @@ float dr4::SRGBUint8ToLinearFloat(const uint8_t u) {
 	return stbir__srgb_uchar_to_linear_float[u];
 }
 
+//
+// Row conversion kernels
+//
+// The linear to sRGB kernels evaluate the same integer expression as stbir__linear_to_srgb_uchar:
+// clamp to [2^-13, 1-eps], look up bias and scale by exponent and top mantissa bits, interpolate with
+// the next 8 mantissa bits. Results are bit identical to ToSRGBA for all finite inputs.
+//
+
+namespace {
+
+	const bool HasAVX2 = dr4::CpuFeatures::Get().avx2;
+
+#if defined(DR4_X86)
+	// Converts one pixel, rgb lanes to sRGB and alpha lane to 8 bit linear, as 32 bit integers
+	inline __m128i linearToSrgbPixelSSE2(__m128 in) {
+		const __m128 minval = _mm_castsi128_ps(_mm_set1_epi32((127 - 13) << 23));
+		const __m128 almostone = _mm_castsi128_ps(_mm_set1_epi32(0x3f7fffff));
+		const __m128i alphaMask = _mm_setr_epi32(0, 0, 0, -1);
+
+		// max returns the second operand for NaN, so NaN maps to minval as in the reference
+		__m128 f = _mm_min_ps(_mm_max_ps(in, minval), almostone);
+		__m128i u = _mm_castps_si128(f);
+		__m128i idx = _mm_srli_epi32(_mm_sub_epi32(u, _mm_castps_si128(minval)), 20);
+		alignas(16) uint32_t i4[4];
+		_mm_store_si128((__m128i*)i4, idx);
+		__m128i tab = _mm_setr_epi32(fp32_to_srgb8_tab4[i4[0]], fp32_to_srgb8_tab4[i4[1]], fp32_to_srgb8_tab4[i4[2]], 0);
+		__m128i bias = _mm_slli_epi32(_mm_srli_epi32(tab, 16), 9);
+		__m128i scale = _mm_and_si128(tab, _mm_set1_epi32(0xffff));
+		__m128i t = _mm_and_si128(_mm_srli_epi32(u, 12), _mm_set1_epi32(0xff));
+		// scale and t fit in the low 16 bits, madd yields their 32 bit product
+		__m128i srgb = _mm_srli_epi32(_mm_add_epi32(bias, _mm_madd_epi16(scale, t)), 16);
+
+		__m128 a = _mm_min_ps(_mm_max_ps(in, _mm_setzero_ps()), _mm_set1_ps(1.f));
+		__m128i alpha = _mm_cvttps_epi32(_mm_mul_ps(a, _mm_set1_ps(255.f)));
+		return _mm_or_si128(_mm_andnot_si128(alphaMask, srgb), _mm_and_si128(alphaMask, alpha));
+	}
+
+	size_t linearToSrgbSSE2(const dr4::RGBAFloat32* src, dr4::SRGBA* dst, size_t count) {
+		const float* in = &src->r;
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128i p0 = linearToSrgbPixelSSE2(_mm_loadu_ps(in + 4 * i));
+			__m128i p1 = linearToSrgbPixelSSE2(_mm_loadu_ps(in + 4 * i + 4));
+			__m128i p2 = linearToSrgbPixelSSE2(_mm_loadu_ps(in + 4 * i + 8));
+			__m128i p3 = linearToSrgbPixelSSE2(_mm_loadu_ps(in + 4 * i + 12));
+			__m128i packed = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+			_mm_storeu_si128((__m128i*)(dst + i), packed);
+		}
+		return i;
+	}
+
+	// Converts two pixels per register, table entries fetched with gather
+	DR4_TARGET_AVX2
+	inline __m256i linearToSrgbPixelsAVX2(__m256 in) {
+		const __m256 minval = _mm256_castsi256_ps(_mm256_set1_epi32((127 - 13) << 23));
+		const __m256 almostone = _mm256_castsi256_ps(_mm256_set1_epi32(0x3f7fffff));
+
+		__m256 f = _mm256_min_ps(_mm256_max_ps(in, minval), almostone);
+		__m256i u = _mm256_castps_si256(f);
+		__m256i idx = _mm256_srli_epi32(_mm256_sub_epi32(u, _mm256_castps_si256(minval)), 20);
+		__m256i tab = _mm256_i32gather_epi32((const int*)fp32_to_srgb8_tab4, idx, 4);
+		__m256i bias = _mm256_slli_epi32(_mm256_srli_epi32(tab, 16), 9);
+		__m256i scale = _mm256_and_si256(tab, _mm256_set1_epi32(0xffff));
+		__m256i t = _mm256_and_si256(_mm256_srli_epi32(u, 12), _mm256_set1_epi32(0xff));
+		__m256i srgb = _mm256_srli_epi32(_mm256_add_epi32(bias, _mm256_madd_epi16(scale, t)), 16);
+
+		__m256 a = _mm256_min_ps(_mm256_max_ps(in, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+		__m256i alpha = _mm256_cvttps_epi32(_mm256_mul_ps(a, _mm256_set1_ps(255.f)));
+		return _mm256_blend_epi32(srgb, alpha, 0x88);
+	}
+
+	// Eight pixels per iteration
+	DR4_TARGET_AVX2
+	size_t linearToSrgbAVX2(const dr4::RGBAFloat32* src, dr4::SRGBA* dst, size_t count) {
+		const float* in = &src->r;
+		const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256i p01 = linearToSrgbPixelsAVX2(_mm256_loadu_ps(in + 4 * i));
+			__m256i p23 = linearToSrgbPixelsAVX2(_mm256_loadu_ps(in + 4 * i + 8));
+			__m256i p45 = linearToSrgbPixelsAVX2(_mm256_loadu_ps(in + 4 * i + 16));
+			__m256i p67 = linearToSrgbPixelsAVX2(_mm256_loadu_ps(in + 4 * i + 24));
+			// packs work within 128 bit halves, the permute restores pixel order
+			__m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(p01, p23), _mm256_packs_epi32(p45, p67));
+			_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permutevar8x32_epi32(packed, order));
+		}
+		return i;
+	}
+
+	// Eight pixels per iteration, rgb through the sRGB table, alpha scaled
+	DR4_TARGET_AVX2
+	size_t srgbToLinearAVX2(const dr4::SRGBA* src, dr4::RGBAFloat32* dst, size_t count) {
+		const uint8_t* in = &src->r;
+		float* out = &dst->r;
+		const __m256 ia = _mm256_set1_ps(1.f / 255.f);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			for (size_t k = 0; k < 8; k += 2) {
+				__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + 4 * (i + k))));
+				__m256 rgb = _mm256_i32gather_ps(stbir__srgb_uchar_to_linear_float, v, 4);
+				__m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(v), ia);
+				_mm256_storeu_ps(out + 4 * (i + k), _mm256_blend_ps(rgb, alpha, 0x88));
+			}
+		}
+		return i;
+	}
+#endif
+}
+
+void dr4::LinearToSRGBRow(const RGBAFloat32* linear, SRGBA* srgb, size_t count) {
+	size_t i = 0;
+#if defined(DR4_X86)
+	i = HasAVX2 ? linearToSrgbAVX2(linear, srgb, count) : linearToSrgbSSE2(linear, srgb, count);
+#endif
+	for (; i < count; i++)
+		srgb[i] = ToSRGBA(linear[i]);
+}
+
+void dr4::SRGBToLinearRow(const SRGBA* srgb, RGBAFloat32* linear, size_t count) {
+	size_t i = 0;
+#if defined(DR4_X86)
+	if (HasAVX2)
+		i = srgbToLinearAVX2(srgb, linear, count);
+#endif
+	for (; i < count; i++)
+		linear[i] = ToRGBAFloat(srgb[i]);
+}
+
 dr4::ImageRGBA8SRGB dr4::convertRBGA32LinearToSrgb(const ImageRGBA32Linear& linear)
 {
 	ImageRGBA8SRGB res(linear.size());
-	auto seq = make_seq(linear.elementCount());
-	for (auto i : seq) {
-		res.at(i) = ToSRGBA(linear.at(i));
-	}
+	const size_t width = linear.dim1();
+	parallelFor2D(res, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		LinearToSRGBRow(linear.data() + linear.index2d(0, band.y0), res.data() + res.index2d(0, band.y0), width * band.height());
+	});
 	return res;
 }
 
 dr4::ImageRGBA32Linear dr4::convertToLinear(const ImageRGBA8SRGB& srgb)
 {
 	ImageRGBA32Linear res(srgb.size());
-	auto seq = make_seq(srgb.elementCount());
-	for (auto i : seq) {
-		res.at(i) = ToRGBAFloat(srgb.at(i));
-	}
+	const size_t width = srgb.dim1();
+	parallelFor2D(res, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		SRGBToLinearRow(srgb.data() + srgb.index2d(0, band.y0), res.data() + res.index2d(0, band.y0), width * band.height());
+	});
 	return res;
 }
 
@@ -0,0 +1,309 @@
+// This file is part of dr4w, a library for computer graphics routines.
+//
+// Copyright (C) 2020 Mikko Kuitunen <mikko.kuitunen@iki.fi>
+//
+// This Source Code Form is subject to the terms of the MIT License (see LICENSE.txt)
+
+#include <dr4/dr4_image_planar.h>
+#include <dr4/dr4_cpu.h>
+#include <dr4/dr4_parallel.h>
+
+#include <cassert>
+
+#if defined(DR4_X86)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+	using dr4::ImageRGBA32LinearPlanar;
+	using dr4::ImageFloat32Planar;
+
+	const bool HasAVX2 = dr4::CpuFeatures::Get().avx2;
+
+	// Row pointers of the four channels
+	struct PlanarRow {
+		float* c[4];
+	};
+
+	struct ConstPlanarRow {
+		const float* c[4];
+	};
+
+	PlanarRow rowOf(ImageRGBA32LinearPlanar& image, size_t y) {
+		return { { image.row(0, y), image.row(1, y), image.row(2, y), image.row(3, y) } };
+	}
+
+	ConstPlanarRow rowOf(const ImageRGBA32LinearPlanar& image, size_t y) {
+		return { { image.row(0, y), image.row(1, y), image.row(2, y), image.row(3, y) } };
+	}
+
+#if defined(DR4_X86)
+
+	//
+	// SSE2 kernels, four pixels per step. Row strides are multiples of eight floats.
+	//
+
+	void blendSSE2(ConstPlanarRow s, PlanarRow t, size_t count) {
+		const __m128 one = _mm_set1_ps(1.f);
+		for (size_t i = 0; i < count; i += 4) {
+			const __m128 sa = _mm_load_ps(s.c[3] + i);
+			const __m128 ta = _mm_load_ps(t.c[3] + i);
+			const __m128 fb = _mm_sub_ps(one, sa);
+			const __m128 a0 = _mm_add_ps(sa, _mm_mul_ps(ta, fb));
+			for (size_t c = 0; c < 3; c++) {
+				__m128 v = _mm_add_ps(_mm_mul_ps(sa, _mm_load_ps(s.c[c] + i)), _mm_mul_ps(_mm_mul_ps(ta, _mm_load_ps(t.c[c] + i)), fb));
+				_mm_store_ps(t.c[c] + i, _mm_div_ps(v, a0));
+			}
+			_mm_store_ps(t.c[3] + i, a0);
+		}
+	}
+
+	void blendCoverageSSE2(const dr4::RGBAFloat32& color, const float* coverage, PlanarRow t, size_t count) {
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 ca = _mm_set1_ps(color.a);
+		const __m128 sc[3] = { _mm_set1_ps(color.r), _mm_set1_ps(color.g), _mm_set1_ps(color.b) };
+		for (size_t i = 0; i < count; i += 4) {
+			const __m128 sa = _mm_mul_ps(ca, _mm_load_ps(coverage + i));
+			const __m128 ta = _mm_load_ps(t.c[3] + i);
+			const __m128 fb = _mm_sub_ps(one, sa);
+			const __m128 a0 = _mm_add_ps(sa, _mm_mul_ps(ta, fb));
+			for (size_t c = 0; c < 3; c++) {
+				__m128 v = _mm_add_ps(_mm_mul_ps(sa, sc[c]), _mm_mul_ps(_mm_mul_ps(ta, _mm_load_ps(t.c[c] + i)), fb));
+				_mm_store_ps(t.c[c] + i, _mm_div_ps(v, a0));
+			}
+			_mm_store_ps(t.c[3] + i, a0);
+		}
+	}
+
+	void lerpSSE2(const float* src, const float* dst, const float* u, float uconst, float* res, size_t count) {
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 uc = _mm_set1_ps(uconst);
+		for (size_t i = 0; i < count; i += 4) {
+			const __m128 ui = u ? _mm_load_ps(u + i) : uc;
+			__m128 v = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, ui), _mm_load_ps(src + i)), _mm_mul_ps(ui, _mm_load_ps(dst + i)));
+			_mm_store_ps(res + i, v);
+		}
+	}
+
+	//
+	// AVX2 kernels, eight pixels per step
+	//
+
+	DR4_TARGET_AVX2
+	void blendAVX2(ConstPlanarRow s, PlanarRow t, size_t count) {
+		const __m256 one = _mm256_set1_ps(1.f);
+		for (size_t i = 0; i < count; i += 8) {
+			const __m256 sa = _mm256_load_ps(s.c[3] + i);
+			const __m256 ta = _mm256_load_ps(t.c[3] + i);
+			const __m256 fb = _mm256_sub_ps(one, sa);
+			const __m256 a0 = _mm256_add_ps(sa, _mm256_mul_ps(ta, fb));
+			for (size_t c = 0; c < 3; c++) {
+				__m256 v = _mm256_add_ps(_mm256_mul_ps(sa, _mm256_load_ps(s.c[c] + i)),
+					_mm256_mul_ps(_mm256_mul_ps(ta, _mm256_load_ps(t.c[c] + i)), fb));
+				_mm256_store_ps(t.c[c] + i, _mm256_div_ps(v, a0));
+			}
+			_mm256_store_ps(t.c[3] + i, a0);
+		}
+	}
+
+	DR4_TARGET_AVX2
+	void blendCoverageAVX2(const dr4::RGBAFloat32& color, const float* coverage, PlanarRow t, size_t count) {
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256 ca = _mm256_set1_ps(color.a);
+		const __m256 sc[3] = { _mm256_set1_ps(color.r), _mm256_set1_ps(color.g), _mm256_set1_ps(color.b) };
+		for (size_t i = 0; i < count; i += 8) {
+			const __m256 sa = _mm256_mul_ps(ca, _mm256_load_ps(coverage + i));
+			const __m256 ta = _mm256_load_ps(t.c[3] + i);
+			const __m256 fb = _mm256_sub_ps(one, sa);
+			const __m256 a0 = _mm256_add_ps(sa, _mm256_mul_ps(ta, fb));
+			for (size_t c = 0; c < 3; c++) {
+				__m256 v = _mm256_add_ps(_mm256_mul_ps(sa, sc[c]), _mm256_mul_ps(_mm256_mul_ps(ta, _mm256_load_ps(t.c[c] + i)), fb));
+				_mm256_store_ps(t.c[c] + i, _mm256_div_ps(v, a0));
+			}
+			_mm256_store_ps(t.c[3] + i, a0);
+		}
+	}
+
+	DR4_TARGET_AVX2
+	void lerpAVX2(const float* src, const float* dst, const float* u, float uconst, float* res, size_t count) {
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256 uc = _mm256_set1_ps(uconst);
+		for (size_t i = 0; i < count; i += 8) {
+			const __m256 ui = u ? _mm256_load_ps(u + i) : uc;
+			__m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(one, ui), _mm256_load_ps(src + i)), _mm256_mul_ps(ui, _mm256_load_ps(dst + i)));
+			_mm256_store_ps(res + i, v);
+		}
+	}
+
+#else
+
+	//
+	// Scalar kernels, identical arithmetic to BlendAlpha and Lerp
+	//
+
+	void blendScalar(ConstPlanarRow s, PlanarRow t, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			const float sa = s.c[3][i];
+			const float ta = t.c[3][i];
+			const float fb = 1.f - sa;
+			const float a0 = sa + ta * fb;
+			for (size_t c = 0; c < 3; c++)
+				t.c[c][i] = (sa * s.c[c][i] + ta * t.c[c][i] * fb) / a0;
+			t.c[3][i] = a0;
+		}
+	}
+
+	void blendCoverageScalar(const dr4::RGBAFloat32& color, const float* coverage, PlanarRow t, size_t count) {
+		const float sc[3] = { color.r, color.g, color.b };
+		for (size_t i = 0; i < count; i++) {
+			const float sa = color.a * coverage[i];
+			const float ta = t.c[3][i];
+			const float fb = 1.f - sa;
+			const float a0 = sa + ta * fb;
+			for (size_t c = 0; c < 3; c++)
+				t.c[c][i] = (sa * sc[c] + ta * t.c[c][i] * fb) / a0;
+			t.c[3][i] = a0;
+		}
+	}
+
+	void lerpScalar(const float* src, const float* dst, const float* u, float uconst, float* res, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			const float ui = u ? u[i] : uconst;
+			res[i] = (1.0f - ui) * src[i] + ui * dst[i];
+		}
+	}
+#endif
+
+	void blendRow(ConstPlanarRow s, PlanarRow t, size_t count) {
+#if defined(DR4_X86)
+		if (HasAVX2) blendAVX2(s, t, count);
+		else blendSSE2(s, t, count);
+#else
+		blendScalar(s, t, count);
+#endif
+	}
+
+	void blendCoverageRow(const dr4::RGBAFloat32& color, const float* coverage, PlanarRow t, size_t count) {
+#if defined(DR4_X86)
+		if (HasAVX2) blendCoverageAVX2(color, coverage, t, count);
+		else blendCoverageSSE2(color, coverage, t, count);
+#else
+		blendCoverageScalar(color, coverage, t, count);
+#endif
+	}
+
+	void lerpRow(const float* src, const float* dst, const float* u, float uconst, float* res, size_t count) {
+#if defined(DR4_X86)
+		if (HasAVX2) lerpAVX2(src, dst, u, uconst, res, count);
+		else lerpSSE2(src, dst, u, uconst, res, count);
+#else
+		lerpScalar(src, dst, u, uconst, res, count);
+#endif
+	}
+
+	template<class A, class B>
+	bool sameSize(const A& a, const B& b) {
+		return a.dim1() == b.dim1() && a.dim2() == b.dim2();
+	}
+}
+
+dr4::ImageRGBA32LinearPlanar dr4::convertToPlanar(const ImageRGBA32Linear& image) {
+	ImageRGBA32LinearPlanar res(image.size());
+	const size_t width = image.dim1();
+	parallelFor2D(res, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		for (size_t y = band.y0; y < band.y1; y++) {
+			const RGBAFloat32* src = image.data() + image.index2d(0, y);
+			PlanarRow dst = rowOf(res, y);
+			size_t x = 0;
+#if defined(DR4_X86)
+			// 4x4 transpose of four interleaved pixels into four channel vectors
+			for (; x + 4 <= width; x += 4) {
+				__m128 r = _mm_loadu_ps(&src[x].r);
+				__m128 g = _mm_loadu_ps(&src[x + 1].r);
+				__m128 b = _mm_loadu_ps(&src[x + 2].r);
+				__m128 a = _mm_loadu_ps(&src[x + 3].r);
+				_MM_TRANSPOSE4_PS(r, g, b, a);
+				_mm_store_ps(dst.c[0] + x, r);
+				_mm_store_ps(dst.c[1] + x, g);
+				_mm_store_ps(dst.c[2] + x, b);
+				_mm_store_ps(dst.c[3] + x, a);
+			}
+#endif
+			for (; x < width; x++) {
+				dst.c[0][x] = src[x].r;
+				dst.c[1][x] = src[x].g;
+				dst.c[2][x] = src[x].b;
+				dst.c[3][x] = src[x].a;
+			}
+		}
+	});
+	return res;
+}
+
+dr4::ImageRGBA32Linear dr4::convertToInterleaved(const ImageRGBA32LinearPlanar& image) {
+	ImageRGBA32Linear res(image.size());
+	const size_t width = image.dim1();
+	parallelFor2D(res, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		for (size_t y = band.y0; y < band.y1; y++) {
+			ConstPlanarRow src = rowOf(image, y);
+			RGBAFloat32* dst = res.data() + res.index2d(0, y);
+			size_t x = 0;
+#if defined(DR4_X86)
+			for (; x + 4 <= width; x += 4) {
+				__m128 p0 = _mm_load_ps(src.c[0] + x);
+				__m128 p1 = _mm_load_ps(src.c[1] + x);
+				__m128 p2 = _mm_load_ps(src.c[2] + x);
+				__m128 p3 = _mm_load_ps(src.c[3] + x);
+				_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+				_mm_storeu_ps(&dst[x].r, p0);
+				_mm_storeu_ps(&dst[x + 1].r, p1);
+				_mm_storeu_ps(&dst[x + 2].r, p2);
+				_mm_storeu_ps(&dst[x + 3].r, p3);
+			}
+#endif
+			for (; x < width; x++)
+				dst[x] = { src.c[0][x], src.c[1][x], src.c[2][x], src.c[3][x] };
+		}
+	});
+	return res;
+}
+
+void dr4::Fill(ImageRGBA32LinearPlanar& target, const RGBAFloat32& color) {
+	target.fill({ color.r, color.g, color.b, color.a });
+}
+
+void dr4::BlendAlpha(const ImageRGBA32LinearPlanar& source, ImageRGBA32LinearPlanar& target) {
+	assert(sameSize(source, target));
+	parallelFor2D(target, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		for (size_t y = band.y0; y < band.y1; y++)
+			blendRow(rowOf(source, y), rowOf(target, y), target.stride());
+	});
+}
+
+void dr4::BlendAlpha(const RGBAFloat32& color, const ImageFloat32Planar& coverage, ImageRGBA32LinearPlanar& target) {
+	assert(sameSize(coverage, target));
+	parallelFor2D(target, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		for (size_t y = band.y0; y < band.y1; y++)
+			blendCoverageRow(color, coverage.row(0, y), rowOf(target, y), target.stride());
+	});
+}
+
+void dr4::Lerp(const ImageRGBA32LinearPlanar& src, const ImageRGBA32LinearPlanar& dst, float u, ImageRGBA32LinearPlanar& result) {
+	assert(sameSize(src, dst) && sameSize(src, result));
+	parallelFor2D(result, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		for (size_t c = 0; c < ImageRGBA32LinearPlanar::ChannelCount; c++)
+			for (size_t y = band.y0; y < band.y1; y++)
+				lerpRow(src.row(c, y), dst.row(c, y), nullptr, u, result.row(c, y), result.stride());
+	});
+}
+
+void dr4::Lerp(const ImageRGBA32LinearPlanar& src, const ImageRGBA32LinearPlanar& dst, const ImageFloat32Planar& u,
+	ImageRGBA32LinearPlanar& result) {
+	assert(sameSize(src, dst) && sameSize(src, result) && sameSize(src, u));
+	parallelFor2D(result, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		for (size_t c = 0; c < ImageRGBA32LinearPlanar::ChannelCount; c++)
+			for (size_t y = band.y0; y < band.y1; y++)
+				lerpRow(src.row(c, y), dst.row(c, y), u.row(0, y), 0.f, result.row(c, y), result.stride());
+	});
+}
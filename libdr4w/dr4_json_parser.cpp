@@ -20,20 +20,36 @@ namespace dr4 {
 
     // Normalized<float>
     void to_json(json& j, const Normalized<float>& n) {
-        float val = n.value();
-        j = json{ val };
+        j = n.value();
     }
     void from_json(const json& j, Normalized<float>& n) {
-        float f = j;
+        // earlier versions wrote the value as a single element array
+        float f = j.is_array() ? j.at(0).get<float>() : j.get<float>();
         n = Normalized(f);
     }
     NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Blend, type, opacity)
     NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Material2D, linewidth, colorFill, colorLine)
     NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ColorFill, colorFill)
 
+    NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(PointList2D, points)
+    NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Polygon2D, points)
+
+    // Triangulation is not serialized, it is recreated on read
+    void to_json(json& j, const PolygonFill2D& p) {
+        j = json{ {"polygon", p.polygon}, {"material", p.material} };
+    }
+    void from_json(const json& j, PolygonFill2D& p) {
+        Polygon2D polygon;
+        size_t material;
+        j.at("polygon").get_to(polygon);
+        j.at("material").get_to(material);
+        p = PolygonFill2D::Create(polygon, material);
+    }
+
     NLOHMANN_JSON_SERIALIZE_ENUM(Content2D, {
         {Content2D::Fill,"Fill" },
-        {Content2D::Lines, "Lines"}
+        {Content2D::Lines, "Lines"},
+        {Content2D::Polygon, "Polygon"}
      })
     
     NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Graphics2DElement, content, idx)
@@ -51,6 +67,7 @@ namespace dr4 {
         j = json{
             {"lines", s.lines},
             {"colorFills", s.colorFills},
+            {"polygons", s.polygons},
             {"layers", s.layers},
             {"materials", s.materials},
             {"scalarPresentation", s.scalarPresentation}
@@ -58,7 +75,7 @@ namespace dr4 {
     }
 
     #define DR4_TRY_SET_FROM_JSON(jsonparam_, fieldName_, targetElem_)\
-        try {jsonparam_.at(#fieldName_).get_to(targetElem_.##fieldName_);}catch(...){}
+        try {jsonparam_.at(#fieldName_).get_to(targetElem_.fieldName_);}catch(...){}
 
     void from_json(const json& j, Scene2D& p) {
         p = Scene2D();
@@ -66,6 +83,7 @@ namespace dr4 {
         // accept all plausible jsons leniently as scene
         DR4_TRY_SET_FROM_JSON(j, lines, p)
         DR4_TRY_SET_FROM_JSON(j, colorFills, p)
+        DR4_TRY_SET_FROM_JSON(j, polygons, p)
         DR4_TRY_SET_FROM_JSON(j, layers, p)
         DR4_TRY_SET_FROM_JSON(j, materials, p)
         DR4_TRY_SET_FROM_JSON(j, scalarPresentation, p)
@@ -122,6 +140,10 @@ public:
 
 };
 
+std::string dr4::Json::toString() const {
+    return json ? json->json.dump() : std::string();
+}
+
 std::string dr4::Json::compress() const {
     return json->compress();
 }
@@ -150,7 +172,7 @@ dr4::Json dr4::CreateJson()
 {
     Json j;
     j.json = std::make_shared<JsonImpl>();
-	return Json();
+	return j;
 }
 
 dr4::Json dr4::JsonParser::toJson(const Scene2D& scene) const
@@ -162,6 +184,8 @@ dr4::Json dr4::JsonParser::toJson(const Scene2D& scene) const
 
 bool dr4::JsonParser::fromJson(const Json& json, dr4::Scene2D& out)
 {
+    if (!json.json)
+        return false;
     from_json(json.json->json, out);
     return true;
 }
\ No newline at end of file
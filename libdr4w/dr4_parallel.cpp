@@ -0,0 +1,59 @@
+// This file is part of dr4w, a library for computer graphics routines.
+//
+// Copyright (C) 2020 Mikko Kuitunen <mikko.kuitunen@iki.fi>
+//
+// This Source Code Form is subject to the terms of the MIT License (see LICENSE.txt)
+
+#include <dr4/dr4_parallel.h>
+#include <dr4/dr4_threadpool.h>
+
+#include <algorithm>
+
+namespace {
+	// Items per thread, more than one so that threads finishing early can take work from slower ones
+	const size_t ItemsPerThread = 8;
+
+	size_t divUp(size_t a, size_t b) { return (a + b - 1) / b; }
+
+	bool isSmall(size_t width, size_t height, const dr4::ParallelGrain& grain) {
+		return width * height < 2 * std::max<size_t>(1, grain.minElements);
+	}
+}
+
+void dr4::parallelFor2D(ThreadPool& pool, size_t width, size_t height, ParallelGrain grain,
+	const std::function<void(const ParallelRange2D&)>& fun)
+{
+	if (width == 0 || height == 0)
+		return;
+	if (isSmall(width, height, grain) || pool.workerCount() == 0) {
+		fun({ 0, 0, width, height });
+		return;
+	}
+	const size_t minElements = std::max<size_t>(1, grain.minElements);
+	const size_t maxItems = ItemsPerThread * (pool.workerCount() + 1);
+
+	// Columns of blocks, a single column for row bands
+	const size_t blockWidth = grain.blockWidth == 0 ? width : std::min(width, grain.blockWidth);
+	const size_t columns = divUp(width, blockWidth);
+	// Rows of blocks, as many as the grain allows without exceeding maxItems
+	const size_t minRows = divUp(minElements, blockWidth);
+	const size_t rows = std::max<size_t>(1, std::min(height / minRows, maxItems / columns));
+	const size_t blockHeight = divUp(height, rows);
+	const size_t rowCount = divUp(height, blockHeight);
+
+	pool.parallelFor(columns * rowCount, [&](size_t i) {
+		const size_t x0 = (i % columns) * blockWidth;
+		const size_t y0 = (i / columns) * blockHeight;
+		fun({ x0, y0, std::min(width, x0 + blockWidth), std::min(height, y0 + blockHeight) });
+	});
+}
+
+void dr4::parallelFor2D(size_t width, size_t height, ParallelGrain grain, const std::function<void(const ParallelRange2D&)>& fun)
+{
+	// Small arrays do not start the global pool
+	if (width != 0 && height != 0 && isSmall(width, height, grain)) {
+		fun({ 0, 0, width, height });
+		return;
+	}
+	parallelFor2D(ThreadPool::Global(), width, height, grain, fun);
+}
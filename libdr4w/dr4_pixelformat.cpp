@@ -0,0 +1,395 @@
+#include <dr4/dr4_pixelformat.h>
+#include <dr4/dr4_cpu.h>
+#include <dr4/dr4_math.h>
+#include <dr4/dr4_parallel.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(DR4_X86)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+	inline uint32_t floatBits(float f) { uint32_t u; std::memcpy(&u, &f, sizeof(u)); return u; }
+	inline float bitsFloat(uint32_t u) { float f; std::memcpy(&f, &u, sizeof(f)); return f; }
+
+	// a * b / 255 rounded, exact for 8 bit a and b
+	inline uint32_t mul255(uint32_t a, uint32_t b) {
+		uint32_t t = a * b + 128;
+		return (t + (t >> 8)) >> 8;
+	}
+
+	const bool HasF16C = dr4::CpuFeatures::Get().f16c;
+	const bool HasAVX2 = dr4::CpuFeatures::Get().avx2;
+
+#if defined(DR4_X86)
+	DR4_TARGET_AVX2
+	void fillFloatAVX2(dr4::RGBAFloat32* row, size_t count, const dr4::RGBAFloat32& pixel) {
+		// two pixels per 256 bit store
+		const __m256 c2 = _mm256_setr_ps(pixel.r, pixel.g, pixel.b, pixel.a, pixel.r, pixel.g, pixel.b, pixel.a);
+		float* dst = &row->r;
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+			_mm256_storeu_ps(dst + 4 * i, c2);
+		if (i < count)
+			_mm_storeu_ps(dst + 4 * i, _mm_loadu_ps(&pixel.r));
+	}
+
+	void fillFloatSSE2(dr4::RGBAFloat32* row, size_t count, const dr4::RGBAFloat32& pixel) {
+		const __m128 c = _mm_loadu_ps(&pixel.r);
+		float* dst = &row->r;
+		for (size_t i = 0; i < count; i++)
+			_mm_storeu_ps(dst + 4 * i, c);
+	}
+
+	// Premultiplied over operator on half floats, two pixels per step
+	DR4_TARGET_F16C
+	void blendHalfF16C(dr4::RGBAHalf16* row, const float* coverage, size_t count, const dr4::RGBAHalf16& src) {
+		const __m128 s = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)&src));
+		const __m256 s2 = _mm256_insertf128_ps(_mm256_castps128_ps256(s), s, 1);
+		const __m256 one = _mm256_set1_ps(1.f);
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2) {
+			__m256 c = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(coverage[i])), _mm_set1_ps(coverage[i + 1]), 1);
+			__m256 d = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(row + i)));
+			__m256 sc = _mm256_mul_ps(s2, c);
+			__m256 inva = _mm256_sub_ps(one, _mm256_permute_ps(sc, _MM_SHUFFLE(3, 3, 3, 3)));
+			__m256 o = _mm256_add_ps(sc, _mm256_mul_ps(d, inva));
+			_mm_storeu_si128((__m128i*)(row + i), _mm256_cvtps_ph(o, _MM_FROUND_TO_NEAREST_INT));
+		}
+		if (i < count) {
+			__m128 d = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(row + i)));
+			__m128 sc = _mm_mul_ps(s, _mm_set1_ps(coverage[i]));
+			__m128 inva = _mm_sub_ps(_mm_set1_ps(1.f), _mm_shuffle_ps(sc, sc, _MM_SHUFFLE(3, 3, 3, 3)));
+			__m128 o = _mm_add_ps(sc, _mm_mul_ps(d, inva));
+			_mm_storel_epi64((__m128i*)(row + i), _mm_cvtps_ph(o, _MM_FROUND_TO_NEAREST_INT));
+		}
+	}
+
+	DR4_TARGET_F16C
+	void decodeHalfRowF16C(const dr4::RGBAHalf16* row, size_t count, dr4::RGBAFloat32* out) {
+		for (size_t i = 0; i < count; i++)
+			_mm_storeu_ps(&out[i].r, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(row + i))));
+	}
+#endif
+
+	void decodeHalfRow(const dr4::RGBAHalf16* row, size_t count, dr4::RGBAFloat32* out) {
+#if defined(DR4_X86)
+		if (HasF16C) {
+			decodeHalfRowF16C(row, count, out);
+			return;
+		}
+#endif
+		for (size_t i = 0; i < count; i++) {
+			out[i] = { dr4::HalfToFloat(row[i].r), dr4::HalfToFloat(row[i].g),
+				dr4::HalfToFloat(row[i].b), dr4::HalfToFloat(row[i].a) };
+		}
+	}
+
+	inline dr4::RGBAFloat32 unpremultiply(const dr4::RGBAFloat32& c) {
+		if (!(c.a > 0.f))
+			return { 0.f, 0.f, 0.f, 0.f };
+		float ia = 1.f / c.a;
+		return { c.r * ia, c.g * ia, c.b * ia, c.a };
+	}
+
+#if defined(DR4_X86)
+	// BlendAlpha of source pixels with alpha scaled by opacity, one pixel per step. Pixels with zero source alpha
+	// keep the destination as in BlendSpan.
+	void compositeFloatSSE2(dr4::RGBAFloat32* row, const dr4::RGBAFloat32* src, size_t count, float opacity) {
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 op = _mm_set1_ps(opacity);
+		const __m128 alphaLane = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+		for (size_t i = 0; i < count; i++) {
+			const __m128 s = _mm_loadu_ps(&src[i].r);
+			const __m128 t = _mm_loadu_ps(&row[i].r);
+			const __m128 sa = _mm_mul_ps(_mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3)), op);
+			const __m128 ta = _mm_shuffle_ps(t, t, _MM_SHUFFLE(3, 3, 3, 3));
+			const __m128 fb = _mm_sub_ps(one, sa);
+			const __m128 a0 = _mm_add_ps(sa, _mm_mul_ps(ta, fb));
+			__m128 c = _mm_div_ps(_mm_add_ps(_mm_mul_ps(sa, s), _mm_mul_ps(_mm_mul_ps(ta, t), fb)), a0);
+			c = _mm_or_ps(_mm_andnot_ps(alphaLane, c), _mm_and_ps(alphaLane, a0));
+			const __m128 visible = _mm_cmpgt_ps(sa, zero);
+			_mm_storeu_ps(&row[i].r, _mm_or_ps(_mm_and_ps(visible, c), _mm_andnot_ps(visible, t)));
+		}
+	}
+
+	// Premultiplied over operator with the source scaled by opacity, two pixels per step
+	DR4_TARGET_F16C
+	size_t compositeHalfF16C(dr4::RGBAHalf16* row, const dr4::RGBAHalf16* src, size_t count, float opacity) {
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256 op = _mm256_set1_ps(opacity);
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2) {
+			__m256 s = _mm256_mul_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))), op);
+			__m256 d = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(row + i)));
+			__m256 inva = _mm256_sub_ps(one, _mm256_permute_ps(s, _MM_SHUFFLE(3, 3, 3, 3)));
+			__m256 o = _mm256_add_ps(s, _mm256_mul_ps(d, inva));
+			_mm_storeu_si128((__m128i*)(row + i), _mm256_cvtps_ph(o, _MM_FROUND_TO_NEAREST_INT));
+		}
+		return i;
+	}
+
+	// a * b / 255 rounded for 16 bit lanes holding 8 bit values
+	inline __m128i mul255SSE2(__m128i a, __m128i b) {
+		__m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+		return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+	}
+
+	// Integer premultiplied over operator, source scaled by opacity, two pixels per 16 bit lane register
+	inline __m128i compositePixelPairSSE2(__m128i s, __m128i d, __m128i op) {
+		s = mul255SSE2(s, op);
+		__m128i sa = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		__m128i inva = _mm_sub_epi16(_mm_set1_epi16(255), sa);
+		return _mm_adds_epu16(s, mul255SSE2(d, inva));
+	}
+
+	size_t compositeBytesSSE2(dr4::SRGBA8Premultiplied* row, const dr4::SRGBA8Premultiplied* src, size_t count, uint32_t opacity) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i op = _mm_set1_epi16((short)opacity);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+			__m128i d = _mm_loadu_si128((const __m128i*)(row + i));
+			__m128i lo = compositePixelPairSSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), op);
+			__m128i hi = compositePixelPairSSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), op);
+			_mm_storeu_si128((__m128i*)(row + i), _mm_packus_epi16(lo, hi));
+		}
+		return i;
+	}
+#endif
+}
+
+const char* dr4::RenderFormatToString(RenderFormat format) {
+	switch (format) {
+	case RenderFormat::RGBA32F: return "RGBA32F";
+	case RenderFormat::RGBA16FPremultiplied: return "RGBA16FPremultiplied";
+	case RenderFormat::RGBA8Premultiplied: return "RGBA8Premultiplied";
+	}
+	return "<Unknown>";
+}
+
+// Round to nearest even, as the F16C conversion instructions
+uint16_t dr4::FloatToHalf(float f) {
+	const uint32_t f32infinity = 255u << 23;
+	const uint32_t f16max = (127u + 16u) << 23;
+	const uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+	uint32_t x = floatBits(f);
+	uint32_t sign = x & 0x80000000u;
+	x ^= sign;
+
+	uint16_t o;
+	if (x >= f16max) {
+		o = (x > f32infinity) ? 0x7e00 : 0x7c00; // nan stays nan, overflow to infinity
+	}
+	else if (x < (113u << 23)) {
+		// subnormal or zero half, let float addition do the rounding
+		float fx = bitsFloat(x) + bitsFloat(denormMagic);
+		o = (uint16_t)(floatBits(fx) - denormMagic);
+	}
+	else {
+		uint32_t mantissaOdd = (x >> 13) & 1;
+		x += ((uint32_t)(15 - 127) << 23) + 0xfff;
+		x += mantissaOdd;
+		o = (uint16_t)(x >> 13);
+	}
+	return (uint16_t)(o | (sign >> 16));
+}
+
+float dr4::HalfToFloat(uint16_t h) {
+	const uint32_t shiftedExponent = 0x7c00u << 13;
+	uint32_t o = ((uint32_t)h & 0x7fffu) << 13;
+	uint32_t exponent = shiftedExponent & o;
+	o += (127u - 15u) << 23;
+	if (exponent == shiftedExponent) {
+		o += (128u - 16u) << 23; // infinity or nan
+	}
+	else if (exponent == 0) {
+		o += 1u << 23; // zero or subnormal, renormalize
+		o = floatBits(bitsFloat(o) - bitsFloat(113u << 23));
+	}
+	o |= ((uint32_t)h & 0x8000u) << 16;
+	return bitsFloat(o);
+}
+
+//
+// RGBAFloat32
+//
+
+void dr4::PixelFormat<dr4::RGBAFloat32>::BlendSpan(RGBAFloat32* row, const float* coverage, size_t count, const RGBAFloat32& src) {
+	for (size_t i = 0; i < count; i++) {
+		RGBAFloat32 s = src;
+		s.a *= coverage[i];
+		if (s.a > 0.f)
+			row[i] = BlendAlpha(s, row[i]);
+	}
+}
+
+void dr4::PixelFormat<dr4::RGBAFloat32>::FillSpan(RGBAFloat32* row, size_t count, const RGBAFloat32& pixel) {
+#if defined(DR4_X86)
+	if (HasAVX2)
+		fillFloatAVX2(row, count, pixel);
+	else
+		fillFloatSSE2(row, count, pixel);
+#else
+	std::fill(row, row + count, pixel);
+#endif
+}
+
+void dr4::PixelFormat<dr4::RGBAFloat32>::CompositeSpan(RGBAFloat32* row, const RGBAFloat32* src, size_t count, float opacity) {
+#if defined(DR4_X86)
+	compositeFloatSSE2(row, src, count, opacity);
+#else
+	for (size_t i = 0; i < count; i++) {
+		RGBAFloat32 s = src[i];
+		s.a *= opacity;
+		if (s.a > 0.f)
+			row[i] = BlendAlpha(s, row[i]);
+	}
+#endif
+}
+
+dr4::ImageRGBA8SRGB dr4::PixelFormat<dr4::RGBAFloat32>::ToSRGB(const Array2D<RGBAFloat32>& image) {
+	return convertRBGA32LinearToSrgb(image);
+}
+
+//
+// RGBAHalf16
+//
+
+dr4::RGBAHalf16 dr4::PixelFormat<dr4::RGBAHalf16>::Encode(const RGBAFloat32& color) {
+	return { FloatToHalf(color.r * color.a), FloatToHalf(color.g * color.a), FloatToHalf(color.b * color.a), FloatToHalf(color.a) };
+}
+
+dr4::RGBAFloat32 dr4::PixelFormat<dr4::RGBAHalf16>::Decode(const RGBAHalf16& pixel) {
+	return unpremultiply({ HalfToFloat(pixel.r), HalfToFloat(pixel.g), HalfToFloat(pixel.b), HalfToFloat(pixel.a) });
+}
+
+void dr4::PixelFormat<dr4::RGBAHalf16>::BlendSpan(RGBAHalf16* row, const float* coverage, size_t count, const RGBAHalf16& src) {
+#if defined(DR4_X86)
+	if (HasF16C) {
+		blendHalfF16C(row, coverage, count, src);
+		return;
+	}
+#endif
+	const float sr = HalfToFloat(src.r), sg = HalfToFloat(src.g), sb = HalfToFloat(src.b), sa = HalfToFloat(src.a);
+	for (size_t i = 0; i < count; i++) {
+		const float c = coverage[i];
+		const float inva = 1.f - sa * c;
+		RGBAHalf16& d = row[i];
+		d = { FloatToHalf(sr * c + HalfToFloat(d.r) * inva), FloatToHalf(sg * c + HalfToFloat(d.g) * inva),
+			FloatToHalf(sb * c + HalfToFloat(d.b) * inva), FloatToHalf(sa * c + HalfToFloat(d.a) * inva) };
+	}
+}
+
+void dr4::PixelFormat<dr4::RGBAHalf16>::FillSpan(RGBAHalf16* row, size_t count, const RGBAHalf16& pixel) {
+	std::fill(row, row + count, pixel);
+}
+
+void dr4::PixelFormat<dr4::RGBAHalf16>::CompositeSpan(RGBAHalf16* row, const RGBAHalf16* src, size_t count, float opacity) {
+	size_t i = 0;
+#if defined(DR4_X86)
+	if (HasF16C)
+		i = compositeHalfF16C(row, src, count, opacity);
+#endif
+	for (; i < count; i++) {
+		const float sa = HalfToFloat(src[i].a) * opacity;
+		const float inva = 1.f - sa;
+		RGBAHalf16& d = row[i];
+		d.r = FloatToHalf(HalfToFloat(src[i].r) * opacity + HalfToFloat(d.r) * inva);
+		d.g = FloatToHalf(HalfToFloat(src[i].g) * opacity + HalfToFloat(d.g) * inva);
+		d.b = FloatToHalf(HalfToFloat(src[i].b) * opacity + HalfToFloat(d.b) * inva);
+		d.a = FloatToHalf(sa + HalfToFloat(d.a) * inva);
+	}
+}
+
+dr4::ImageRGBA8SRGB dr4::PixelFormat<dr4::RGBAHalf16>::ToSRGB(const Array2D<RGBAHalf16>& image) {
+	ImageRGBA8SRGB res(image.size());
+	parallelFor2D(res, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		std::vector<RGBAFloat32> linear(image.dim1());
+		for (size_t y = band.y0; y < band.y1; y++) {
+			decodeHalfRow(image.data() + image.index2d(0, y), image.dim1(), linear.data());
+			for (auto& pixel : linear)
+				pixel = unpremultiply(pixel);
+			LinearToSRGBRow(linear.data(), res.data() + res.index2d(0, y), image.dim1());
+		}
+	});
+	return res;
+}
+
+//
+// SRGBA8Premultiplied
+//
+
+dr4::SRGBA8Premultiplied dr4::PixelFormat<dr4::SRGBA8Premultiplied>::Encode(const RGBAFloat32& color) {
+	uint32_t a = (uint32_t)(255.f * clampf(color.a, 0.f, 1.f) + 0.5f);
+	return { (uint8_t)mul255(LinearFloatToSRGBUint8(color.r), a), (uint8_t)mul255(LinearFloatToSRGBUint8(color.g), a),
+		(uint8_t)mul255(LinearFloatToSRGBUint8(color.b), a), (uint8_t)a };
+}
+
+dr4::RGBAFloat32 dr4::PixelFormat<dr4::SRGBA8Premultiplied>::Decode(const SRGBA8Premultiplied& pixel) {
+	if (pixel.a == 0)
+		return { 0.f, 0.f, 0.f, 0.f };
+	auto unpremul = [&](uint8_t v) { return (uint8_t)std::min(255u, (v * 255u + pixel.a / 2u) / pixel.a); };
+	return { SRGBUint8ToLinearFloat(unpremul(pixel.r)), SRGBUint8ToLinearFloat(unpremul(pixel.g)),
+		SRGBUint8ToLinearFloat(unpremul(pixel.b)), (float)pixel.a / 255.f };
+}
+
+void dr4::PixelFormat<dr4::SRGBA8Premultiplied>::BlendSpan(SRGBA8Premultiplied* row, const float* coverage, size_t count, const SRGBA8Premultiplied& src) {
+	for (size_t i = 0; i < count; i++) {
+		uint32_t c = (uint32_t)(255.f * coverage[i] + 0.5f);
+		if (c == 0)
+			continue;
+		// source scaled by coverage over destination, integer arithmetic on premultiplied values
+		uint32_t sa = mul255(src.a, c);
+		uint32_t inva = 255u - sa;
+		SRGBA8Premultiplied& d = row[i];
+		d.r = (uint8_t)std::min(255u, mul255(src.r, c) + mul255(d.r, inva));
+		d.g = (uint8_t)std::min(255u, mul255(src.g, c) + mul255(d.g, inva));
+		d.b = (uint8_t)std::min(255u, mul255(src.b, c) + mul255(d.b, inva));
+		d.a = (uint8_t)std::min(255u, sa + mul255(d.a, inva));
+	}
+}
+
+void dr4::PixelFormat<dr4::SRGBA8Premultiplied>::FillSpan(SRGBA8Premultiplied* row, size_t count, const SRGBA8Premultiplied& pixel) {
+	std::fill(row, row + count, pixel);
+}
+
+void dr4::PixelFormat<dr4::SRGBA8Premultiplied>::CompositeSpan(SRGBA8Premultiplied* row, const SRGBA8Premultiplied* src,
+	size_t count, float opacity) {
+	const uint32_t op = (uint32_t)(255.f * clampf(opacity, 0.f, 1.f) + 0.5f);
+	size_t i = 0;
+#if defined(DR4_X86)
+	i = compositeBytesSSE2(row, src, count, op);
+#endif
+	for (; i < count; i++) {
+		const uint32_t sa = mul255(src[i].a, op);
+		const uint32_t inva = 255u - sa;
+		SRGBA8Premultiplied& d = row[i];
+		d.r = (uint8_t)std::min(255u, mul255(src[i].r, op) + mul255(d.r, inva));
+		d.g = (uint8_t)std::min(255u, mul255(src[i].g, op) + mul255(d.g, inva));
+		d.b = (uint8_t)std::min(255u, mul255(src[i].b, op) + mul255(d.b, inva));
+		d.a = (uint8_t)std::min(255u, sa + mul255(d.a, inva));
+	}
+}
+
+dr4::ImageRGBA8SRGB dr4::PixelFormat<dr4::SRGBA8Premultiplied>::ToSRGB(const Array2D<SRGBA8Premultiplied>& image) {
+	ImageRGBA8SRGB res(image.size());
+	parallelFor2D(res, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		for (size_t i = image.index2d(0, band.y0); i < image.index2d(0, band.y1); i++) {
+			const SRGBA8Premultiplied& p = image.at(i);
+			if (p.a == 255 || p.a == 0) {
+				res.at(i) = { p.r, p.g, p.b, p.a };
+			}
+			else {
+				auto unpremul = [&](uint8_t v) { return (uint8_t)std::min(255u, (v * 255u + p.a / 2u) / p.a); };
+				res.at(i) = { unpremul(p.r), unpremul(p.g), unpremul(p.b), p.a };
+			}
+		}
+	});
+	return res;
+}
@@ -0,0 +1,89 @@
+#include <dr4/dr4_profile.h>
+#include <dr4/dr4_io.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+
+dr4::FrameProfile dr4::CollectFrameProfile(const FrameTasks& tasks, size_t frameIndex) {
+	FrameProfile profile;
+	profile.frameIndex = frameIndex;
+	profile.steps = tasks.events;
+	for (const auto& task : tasks.tasks) {
+		if (task->profiling())
+			profile.tasks.push_back({ task->name(), task->profile() });
+	}
+	return profile;
+}
+
+dr4::FrameProfileSummary dr4::SummarizeFrame(const FrameProfile& profile) {
+	FrameProfileSummary summary;
+	int64_t first = std::numeric_limits<int64_t>::max();
+	int64_t last = std::numeric_limits<int64_t>::min();
+	std::set<uint64_t> threads;
+
+	auto add = [&](const ProfileEvent& event) {
+		first = std::min(first, event.profile.startNs);
+		last = std::max(last, event.profile.endNs);
+		summary.primitives += event.profile.primitives;
+		summary.pixels += event.profile.pixels;
+		summary.bytesAllocated += event.profile.bytesAllocated;
+	};
+	for (const auto& step : profile.steps)
+		add(step);
+	for (const auto& task : profile.tasks) {
+		add(task);
+		const double ms = 1e-6 * (double)(task.profile.endNs - task.profile.startNs);
+		summary.taskMs += ms;
+		summary.maxTaskMs = std::max(summary.maxTaskMs, ms);
+		threads.insert(task.profile.threadId);
+	}
+	summary.taskCount = profile.tasks.size();
+	summary.threadCount = threads.size();
+	if (last >= first)
+		summary.wallMs = 1e-6 * (double)(last - first);
+	return summary;
+}
+
+std::string dr4::ChromeTraceJson(const std::vector<FrameProfile>& frames) {
+	// Timestamps relative to the first event, threads numbered in order of appearance
+	int64_t origin = std::numeric_limits<int64_t>::max();
+	for (const auto& frame : frames) {
+		for (const auto& e : frame.steps) origin = std::min(origin, e.profile.startNs);
+		for (const auto& e : frame.tasks) origin = std::min(origin, e.profile.startNs);
+	}
+	std::map<uint64_t, size_t> threadIds;
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool firstEvent = true;
+	auto write = [&](const ProfileEvent& event, const char* category, size_t frameIndex) {
+		auto it = threadIds.emplace(event.profile.threadId, threadIds.size() + 1).first;
+		out << (firstEvent ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"cat\":\"" << category
+			<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << it->second
+			<< ",\"ts\":" << 1e-3 * (double)(event.profile.startNs - origin)
+			<< ",\"dur\":" << 1e-3 * (double)(event.profile.endNs - event.profile.startNs)
+			<< ",\"args\":{\"frame\":" << frameIndex
+			<< ",\"primitives\":" << event.profile.primitives
+			<< ",\"pixels\":" << event.profile.pixels
+			<< ",\"bytesAllocated\":" << event.profile.bytesAllocated << "}}";
+		firstEvent = false;
+	};
+	for (const auto& frame : frames) {
+		for (const auto& step : frame.steps)
+			write(step, "frame", frame.frameIndex);
+		for (const auto& task : frame.tasks)
+			write(task, "task", frame.frameIndex);
+	}
+	out << "\n]}\n";
+	return out.str();
+}
+
+std::string dr4::writeChromeTrace(const std::vector<FrameProfile>& frames, const std::string& path) {
+	std::string json = ChromeTraceJson(frames);
+	return writeBytesToPath(std::vector<uint8_t>(json.begin(), json.end()), path.c_str());
+}
@@ -1,5 +1,12 @@
 #include <dr4/dr4_rasterizer.h>
 #include <dr4/dr4_rasterizer_algorithms.h>
+#include <dr4/dr4_scene2d_index.h>
+#include <dr4/dr4_taskarena.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <optional>
 
 namespace dr4 {
 
@@ -12,6 +19,7 @@ namespace dr4 {
 	class RenderTile{
 		unsigned sourcewidth; // dimensions of the result buffer, not the render tile
 		unsigned sourceheight;
+		PairIdx sourceorigin; // raster position of the left lower corner of the result buffer
 	public:
 		unsigned clipxstart; // render tile positioning into the result buffer
 		unsigned clipystart;
@@ -24,10 +32,17 @@ namespace dr4 {
 			return { clipxstart, clipystart, clipxstop, clipystop};
 		}
 
-		static RenderTile Full(unsigned width, unsigned height) {
+		// Position of the tile origin (left lower corner) in y-up raster coordinates
+		Pairf rasterOffset() const {
+			size_t ybottom = sourceorigin.y + sourceheight - (clipystart + clipheight);
+			return { (float)(sourceorigin.x + clipxstart), (float)ybottom };
+		}
+
+		static RenderTile Full(unsigned width, unsigned height, PairIdx origin = { 0, 0 }) {
 			RenderTile tile;
 			tile.sourcewidth = width;
 			tile.sourceheight = height;
+			tile.sourceorigin = origin;
 			tile.clipxstart = 0;
 			tile.clipystart = 0;
 			tile.clipwidth = tile.sourcewidth;
@@ -36,96 +51,598 @@ namespace dr4 {
 		}
 	};
 
+	// Regular grid of render tiles covering the result buffer. Tiles are stored in row major order
+	// starting from the top row. Tiles on the right and bottom edges are cropped to the buffer.
+	struct RenderTileGrid {
+		unsigned width; // dimensions of the result buffer
+		unsigned height;
+		PairIdx origin; // raster position of the left lower corner of the result buffer
+		unsigned tileWidth;
+		unsigned tileHeight;
+		unsigned columns;
+		unsigned rows;
+		std::vector<RenderTile> tiles;
+
+		// Inclusive range of tile columns and rows
+		struct TileRange {
+			unsigned column0, column1;
+			unsigned row0, row1;
+		};
+
+		size_t tileIndex(unsigned column, unsigned row) const { return (size_t)row * columns + column; }
+
+		// Tiles overlapping raster bounds, nullopt if the bounds fall outside of the buffer
+		std::optional<TileRange> tilesOverlapping(const Span2f& rasterBounds) const {
+			// Bounds relative to the result buffer
+			const float x0 = rasterBounds.x.min - (float)origin.x, x1 = rasterBounds.x.max - (float)origin.x;
+			const float y0 = rasterBounds.y.min - (float)origin.y, y1 = rasterBounds.y.max - (float)origin.y;
+			if (!(x1 >= 0.f && y1 >= 0.f && x0 < (float)width && y0 < (float)height))
+				return std::nullopt;
+
+			// Pixel columns and y-up rows touched by the bounds
+			unsigned px0 = (unsigned)std::max(0.f, x0);
+			unsigned px1 = std::min(width - 1, (unsigned)x1);
+			unsigned py0 = (unsigned)std::max(0.f, y0);
+			unsigned py1 = std::min(height - 1, (unsigned)y1);
+
+			// Tile rows run from top to bottom
+			TileRange range;
+			range.column0 = px0 / tileWidth;
+			range.column1 = px1 / tileWidth;
+			range.row0 = (height - 1 - py1) / tileHeight;
+			range.row1 = (height - 1 - py0) / tileHeight;
+			return range;
+		}
+
+		// Zero tile dimension results in a single tile covering the full buffer.
+		static RenderTileGrid Create(unsigned width, unsigned height, unsigned tileWidth, unsigned tileHeight,
+			PairIdx origin = { 0, 0 }) {
+			RenderTileGrid grid;
+			grid.width = width;
+			grid.height = height;
+			grid.origin = origin;
+			grid.tileWidth = tileWidth > 0 ? std::min(tileWidth, width) : width;
+			grid.tileHeight = tileHeight > 0 ? std::min(tileHeight, height) : height;
+			grid.columns = (width + grid.tileWidth - 1) / grid.tileWidth;
+			grid.rows = (height + grid.tileHeight - 1) / grid.tileHeight;
+			for (unsigned row = 0; row < grid.rows; row++) {
+				for (unsigned column = 0; column < grid.columns; column++) {
+					RenderTile tile = RenderTile::Full(width, height, origin);
+					tile.clipxstart = column * grid.tileWidth;
+					tile.clipystart = row * grid.tileHeight;
+					tile.clipwidth = std::min(grid.tileWidth, width - tile.clipxstart);
+					tile.clipheight = std::min(grid.tileHeight, height - tile.clipystart);
+					grid.tiles.push_back(tile);
+				}
+			}
+			return grid;
+		}
+	};
+
+	// Scene primitive mapped to raster coordinates, the result buffer covers them from RasterConfig2D::bufferOrigin
+	struct RasterPrimitive2D {
+		Content2D content;
+		uint32_t idx; // Index to scene color fills for Content2D::Fill, otherwise to scene materials
+		Pairf points[3]; // Line end points for Content2D::Lines, counterclockwise triangle for Content2D::Polygon
+		float lineWidth; // Stroke width in pixels for Content2D::Lines
+		uint32_t segment; // Layer segment the primitive is drawn to
+	};
+
+	// Consecutive layers drawn to the same buffer. The first segment is drawn directly to the frame. A layer with
+	// a non-default blend or partial opacity is drawn to a buffer of its own and composited over the frame with its
+	// opacity, and layers after it are drawn to another buffer composited at full opacity, so that painting
+	// order is kept.
+	struct LayerSegment2D {
+		size_t layerBegin;
+		size_t layerEnd;
+		float opacity;
+		bool direct; // layers with the default blend at full opacity
+
+		static bool IsDirect(const Layer& layer) {
+			return layer.blend.type == BlendType::Default && layer.blend.opacity.value() >= 1.f;
+		}
+
+		// Segments of the scene layers, the first segment always exists
+		static std::vector<LayerSegment2D> Split(const Scene2D& scene) {
+			std::vector<LayerSegment2D> segments = { { 0, 0, 1.f, true } };
+			for (size_t i = 0; i < scene.layers.size(); i++) {
+				const bool direct = IsDirect(scene.layers[i]);
+				if (direct && segments.back().direct)
+					segments.back().layerEnd = i + 1;
+				else
+					segments.push_back({ i, i + 1, direct ? 1.f : scene.layers[i].blend.opacity.value(), direct });
+			}
+			return segments;
+		}
+	};
+
+	// Primitives of a single frame in painting order, and per tile lists of primitives overlapping each tile.
+	// Bins refer to primitives by index and list them in painting order. Only bins of active tiles are filled.
+	struct FrameBins2D {
+		std::vector<RasterPrimitive2D> primitives;
+		std::vector<std::vector<uint32_t>> bins;
+		std::vector<uint8_t> activeTiles;
+
+		void appendToAll(uint32_t primitiveIdx) {
+			for (size_t i = 0; i < bins.size(); i++) {
+				if (activeTiles[i])
+					bins[i].push_back(primitiveIdx);
+			}
+		}
+
+		void activate(const Span2f& rasterBounds, const RenderTileGrid& grid) {
+			auto range = grid.tilesOverlapping(rasterBounds);
+			if (!range)
+				return;
+			for (unsigned row = range->row0; row <= range->row1; row++) {
+				for (unsigned column = range->column0; column <= range->column1; column++)
+					activeTiles[grid.tileIndex(column, row)] = 1;
+			}
+		}
+
+		bool overlapsActive(const Span2f& rasterBounds, const RenderTileGrid& grid) const {
+			auto range = grid.tilesOverlapping(rasterBounds);
+			if (!range)
+				return false;
+			for (unsigned row = range->row0; row <= range->row1; row++) {
+				for (unsigned column = range->column0; column <= range->column1; column++) {
+					if (activeTiles[grid.tileIndex(column, row)])
+						return true;
+				}
+			}
+			return false;
+		}
+
+		// Append primitive to the bins of the active tiles overlapping raster bounds. Return false if the bounds
+		// do not overlap any active tile.
+		bool append(uint32_t primitiveIdx, const Span2f& rasterBounds, const RenderTileGrid& grid) {
+			auto range = grid.tilesOverlapping(rasterBounds);
+			if (!range)
+				return false;
+			bool appended = false;
+			for (unsigned row = range->row0; row <= range->row1; row++) {
+				for (unsigned column = range->column0; column <= range->column1; column++) {
+					size_t tileIdx = grid.tileIndex(column, row);
+					if (activeTiles[tileIdx]) {
+						bins[tileIdx].push_back(primitiveIdx);
+						appended = true;
+					}
+				}
+			}
+			return appended;
+		}
+	};
+
+	// Raster bounds of a scene element
+	struct ElementBounds2D {
+		Span2f span;
+		bool empty = true;
+		bool everything = false; // covers the whole buffer
+
+		void cover(const Span2f& s) {
+			span = empty ? s : span.cover(s);
+			empty = false;
+		}
+	};
+
+	// Stroke widths up to a pixel are drawn as single pixel lines, wider strokes reach half their width and
+	// the anti-aliasing ramp past the end points
+	inline float strokeReach(float lineWidth) {
+		return lineWidth > 1.f ? 0.5f * lineWidth + 0.5f : 0.f;
+	}
+
+	ElementBounds2D ElementRasterBounds(const LinearMap2D& sceneToRaster, const Scene2D& scene, const Graphics2DElement& g) {
+		ElementBounds2D bounds;
+		if (g.content == Content2D::Fill) {
+			bounds.everything = true;
+			bounds.empty = false;
+		}
+		else if (g.content == Content2D::Lines) {
+			const auto& lines = scene.lines[g.idx];
+			const float reach = strokeReach(scene.materials[lines.material].linewidth);
+			for (const auto& line : lines.lines)
+				bounds.cover(Span2f::Create(sceneToRaster.map(line.fst), sceneToRaster.map(line.snd)).expandSymmetric(reach));
+		}
+		else if (g.content == Content2D::Polygon) {
+			for (const auto& point : scene.polygons[g.idx].polygon.points.points) {
+				Pairf p = sceneToRaster.map(point);
+				bounds.cover(Span2f::Create(p, p));
+			}
+		}
+		return bounds;
+	}
+
+	// Raster bounds of each element limited to the items visible in an index query. Items outside the view do not
+	// touch any tile, so these stand in for the full element bounds of the view.
+	std::vector<std::vector<ElementBounds2D>> IndexedRasterBounds(const LinearMap2D& sceneToRaster, const Scene2D& scene,
+		const Scene2DIndex& index, const std::vector<uint32_t>& visibleItems) {
+		std::vector<std::vector<ElementBounds2D>> bounds(scene.layers.size());
+		for (size_t i = 0; i < scene.layers.size(); i++)
+			bounds[i].resize(scene.layers[i].graphics.size());
+
+		for (uint32_t itemIdx : visibleItems) {
+			const auto& item = index.items()[itemIdx];
+			const auto& g = scene.layers[item.layer].graphics[item.element];
+			auto& elementBounds = bounds[item.layer][item.element];
+			if (g.content == Content2D::Fill) {
+				elementBounds.everything = true;
+				elementBounds.empty = false;
+			}
+			else if (g.content == Content2D::Lines) {
+				const auto& lines = scene.lines[g.idx];
+				const auto& line = lines.lines[item.item];
+				const float reach = strokeReach(scene.materials[lines.material].linewidth);
+				elementBounds.cover(Span2f::Create(sceneToRaster.map(line.fst), sceneToRaster.map(line.snd)).expandSymmetric(reach));
+			}
+			else if (g.content == Content2D::Polygon) {
+				const auto& polygon = scene.polygons[g.idx];
+				for (size_t k = 0; k < 3; k++) {
+					Pairf p = sceneToRaster.map(polygon.polygon.points.points[polygon.triangles[3 * item.item + k]]);
+					elementBounds.cover(Span2f::Create(p, p));
+				}
+			}
+		}
+		return bounds;
+	}
+
+	// Scene span of a width x height buffer at config.bufferOrigin, grown by the widest stroke reach so that
+	// strokes just outside the view that reach into it are included
+	Span2f VisibleSceneSpan(const RasterConfig2D& config, const Scene2D& scene, unsigned width, unsigned height) {
+		float reach = 1.f;
+		for (const auto& material : scene.materials)
+			reach = std::max(reach, strokeReach(material.linewidth) + 1.f);
+		const auto rasterToScene = config.rasterToScene();
+		const float x0 = (float)config.bufferOrigin.x;
+		const float y0 = (float)config.bufferOrigin.y;
+		Pairf p0 = rasterToScene.map({ x0 - reach, y0 - reach });
+		Pairf p1 = rasterToScene.map({ x0 + (float)width + reach, y0 + (float)height + reach });
+		return Span2f::Create(p0, p1);
+	}
+
+	// State of the previous frame used to re-render only the tiles affected by scene changes
+	struct FrameHistory2D {
+		bool valid = false;
+		uint64_t generation = 0; // of the scene, see Scene2DGeneration
+		uint64_t version = 0;
+		LinearMap2D sceneToRaster;
+		PairIdx bufferOrigin = { 0, 0 };
+		std::vector<std::vector<ElementBounds2D>> elementBounds; // per layer, per element
+
+		bool sameView(const LinearMap2D& m, PairIdx origin) const {
+			return sceneToRaster.s == m.s && sceneToRaster.offset.x == m.offset.x && sceneToRaster.offset.y == m.offset.y
+				&& sceneToRaster.origin.x == m.origin.x && sceneToRaster.origin.y == m.origin.y
+				&& bufferOrigin.x == origin.x && bufferOrigin.y == origin.y;
+		}
+	};
+
+	template<class Pixel>
 	struct RenderBuffer {
-		ImageRGBA32Linear color;
+		Array2D<Pixel> color;
 		unsigned width;
 		unsigned height;
 
 		RenderBuffer(unsigned w, unsigned h):width(w), height(h), color(w, h) {
 		}
 
-		void apply(const RenderBuffer& src, RenderTile area /* target space, not source*/) {
-			// copy result - maybe want to blend but do that later
-			// RenderTile should be created based on buffer dimensions so shoudl fit already
-			auto range = area.getRange();
-			unsigned srcY = 0;
-			for (unsigned y = range.y0; y < range.ymax; y++, srcY++){
-				color.copyRowFrom(src.color, { range.x0, y }, { 0, srcY }, range.rowlength());
-			}
+		// View to the area covered by the tile. Views of non-overlapping tiles can be rendered to concurrently.
+		Array2DView<Pixel> tileView(RenderTile tile) {
+			auto range = tile.getRange();
+			return Array2DView<Pixel>(color, { range.x0, range.y0 }, range.rowlength(), range.ymax - range.y0);
 		}
 
 		ImageRGBA8SRGB getColorAsSRGBA() const {
-			return convertRBGA32LinearToSrgb(color);
+			return PixelFormat<Pixel>::ToSRGB(color);
 		}
 	};
 
-
+	// Rasterizer storing the frame in Pixel format
+	template<class Pixel>
 	class Rasterizer_vA : public IRasterizer {
 	public:
 		unsigned m_width;
 		unsigned m_height;
 
-		RenderBuffer m_buffer;
+		RenderBuffer<Pixel> m_buffer;
+		RasterizerConfig m_rasterizerConfig;
+		FrameHistory2D m_history;
+
+		// Layer segments of the current frame, and buffers of the segments after the first one
+		std::vector<LayerSegment2D> m_segments;
+		std::vector<Array2D<Pixel>> m_segmentBuffers;
 
-		Rasterizer_vA(unsigned width, unsigned height):
-			m_width(width), m_height(height), m_buffer(width, height) {
+		// Storage of the frame tasks, reused by the next frame once the tasks have been freed
+		TaskArena m_taskArena;
+		std::shared_ptr<FrameBins2D> m_frameBins;
+		std::vector<std::pair<Array2DView<Pixel>, float>> m_compositeLayers; // segment tile and opacity
+
+		Rasterizer_vA(unsigned width, unsigned height, RasterizerConfig rasterizerConfig):
+			m_width(width), m_height(height), m_buffer(width, height), m_rasterizerConfig(rasterizerConfig) {
+		}
+
+		Array2DView<Pixel> SegmentTileView(uint32_t segment, RenderTile tile) {
+			auto range = tile.getRange();
+			return Array2DView<Pixel>(m_segmentBuffers[segment - 1], { range.x0, range.y0 }, range.rowlength(), range.ymax - range.y0);
 		}
 
 		//
 		// Render tasks
 		//
 
+		// Composites the segments rendered to a tile over the frame, in layer order. Runs as soon as the draw tasks
+		// of the tile are done, while other tiles may still be rendering.
+		class CompositeTask2D : public ITask {
+		public:
+			Array2DView<Pixel> m_frame;
+			std::vector<std::pair<Array2DView<Pixel>, float>>& m_layers; // of the frame, not modified while running
+			std::pair<size_t, size_t> m_layerRange; // layers of the tile
+
+			CompositeTask2D(Array2DView<Pixel> frame, std::vector<std::pair<Array2DView<Pixel>, float>>& layers,
+				std::pair<size_t, size_t> layerRange)
+				:m_frame(frame), m_layers(layers), m_layerRange(layerRange) {}
+
+			virtual const char* name() const override { return "CompositeTask2D"; }
+
+			virtual void doTask() override {
+				for (size_t i = m_layerRange.first; i < m_layerRange.second; i++) {
+					auto& layer = m_layers[i];
+					for (size_t y = 0; y < m_frame.dim2(); y++)
+						PixelFormat<Pixel>::CompositeSpan(m_frame.row(y), layer.first.row(y), m_frame.dim1(), layer.second);
+				}
+				if (profiling()) {
+					const size_t layerCount = m_layerRange.second - m_layerRange.first;
+					profile().primitives += layerCount;
+					profile().pixels += layerCount * m_frame.elementCount();
+				}
+			}
+		};
+
 		class DrawTask2D : public ITask {
 		public:
-			RasterConfig2D m_config;
+			std::shared_ptr<const FrameBins2D> m_bins;
+			size_t m_binIdx;
+			std::pair<uint32_t, uint32_t> m_binRange; // primitives of the segment within the bin
 			const Scene2D& m_scene; // do not modify, only read
 			RenderTile m_tile;
-			RenderBuffer m_buffer;
-			Painter m_painter;
-			//std::shared_ptr<Scene2D> m_scene;
+			PainterT<Pixel> m_painter; // paints directly to the tile area of the segment buffer
 
 			DrawTask2D(
-				RasterConfig2D config,
-				//std::shared_ptr<Scene2D> scene,
+				std::shared_ptr<const FrameBins2D> bins,
+				size_t binIdx,
+				std::pair<uint32_t, uint32_t> binRange,
 				const Scene2D& scene,
-				RenderTile tile) 
-				:m_config(config), m_scene(scene), m_tile(tile),
-					m_buffer(m_tile.clipwidth, m_tile.clipheight),m_painter(m_buffer.color) {}
+				RenderTile tile,
+				Array2DView<Pixel> target) 
+				:m_bins(bins), m_binIdx(binIdx), m_binRange(binRange), m_scene(scene), m_tile(tile), m_painter(target) {
+			}
 
 			virtual ~DrawTask2D(){}
 
-			void drawGraphicsLinesOnlyDBG(const Graphics2DElement& g, Blend blend) {
-				// todo maybe have a separate drawtask class for debug output
-				auto sceneToRaster = m_config.sceneToRaster();
-				if (g.content == Content2D::Fill) {
-					auto fill = m_scene.colorFills[g.idx];
-					m_painter.fill(fill.colorFill);
-				}
-				else if (g.content == Content2D::Lines) {
-					auto lines = m_scene.lines[g.idx];
-					auto material = m_scene.materials[lines.material];
-					for (auto line : lines.lines) {
-						// line coords in scene coordsystem. Rasterize in tile pixel coordinates
-						// transform coords (from->to) scene(s) -> framebuffer(p) ->tile(p)
-						auto rFst = sceneToRaster.map(line.fst);
-						auto rSnd = sceneToRaster.map(line.snd);
-						Razz::DrawLine(m_painter, material.colorLine, rFst.x, rFst.y, rSnd.x, rSnd.y);
-					}
+			void drawPrimitive(const RasterPrimitive2D& primitive, const Pairf& tileOffset) {
+				if (primitive.content == Content2D::Fill) {
+					const auto& fill = m_scene.colorFills[primitive.idx];
+					m_painter.fill(PixelFormat<Pixel>::Encode(fill.colorFill));
+				}
+				else if (primitive.content == Content2D::Lines) {
+					// Primitives are in raster coordinates, the painter covers the tile
+					const auto& material = m_scene.materials[primitive.idx];
+					if (primitive.lineWidth > 1.f)
+						Razz::DrawStroke(m_painter, material.colorLine, primitive.points[0], primitive.points[1],
+							primitive.lineWidth, (int)tileOffset.x, (int)tileOffset.y);
+					else
+						Razz::DrawLineFixed(m_painter, material.colorLine,
+							primitive.points[0], primitive.points[1], (int)tileOffset.x, (int)tileOffset.y);
 				}
+				else if (primitive.content == Content2D::Polygon) {
+					// Vertices are snapped in full buffer coordinates so tile seams do not change coverage
+					const auto& material = m_scene.materials[primitive.idx];
+					Razz::DrawTriangleFixed(m_painter, material.colorFill,
+						primitive.points[0], primitive.points[1], primitive.points[2], (int)tileOffset.x, (int)tileOffset.y);
+				}
+			}
+
+			virtual const char* name() const override { return "DrawTask2D"; }
+
+			// Pixels within the raster bounds of primitive clipped to the tile, an upper bound of the pixels touched
+			uint64_t boundedPixels(const RasterPrimitive2D& primitive, const Span2f& tileBounds) const {
+				Span2f bounds;
+				if (primitive.content == Content2D::Fill)
+					bounds = tileBounds;
+				else if (primitive.content == Content2D::Lines)
+					bounds = Span2f::Create(primitive.points[0], primitive.points[1])
+						.expandSymmetric(std::max(1.f, strokeReach(primitive.lineWidth)));
+				else
+					bounds = Span2f::Create(primitive.points[0], primitive.points[1]).cover(primitive.points[2].x, primitive.points[2].y);
+				auto x = bounds.x.intersect(tileBounds.x);
+				auto y = bounds.y.intersect(tileBounds.y);
+				if (!x.second || !y.second)
+					return 0;
+				return (uint64_t)std::ceil(x.first.length()) * (uint64_t)std::ceil(y.first.length());
 			}
 
 			virtual void doTask() override {
-				// render scene
-				// render layers front to back
-				for (auto layer : m_scene.layers) {
-					for (auto g : layer.graphics) {
-						//drawGraphics(g, layer.blend);
-						drawGraphicsLinesOnlyDBG(g, layer.blend);
-					}
+				// tile starts empty, then render primitives overlapping the tile in painting order
+				m_painter.fill(Pixel{});
+				const Pairf tileOffset = m_tile.rasterOffset();
+				const auto& bin = m_bins->bins[m_binIdx];
+				for (uint32_t i = m_binRange.first; i < m_binRange.second; i++) {
+					drawPrimitive(m_bins->primitives[bin[i]], tileOffset);
+				}
+
+				if (profiling()) {
+					auto size = m_painter.m_img.size();
+					const Span2f tileBounds = Span2f::Create(tileOffset, { tileOffset.x + (float)size.first, tileOffset.y + (float)size.second });
+					auto& p = profile();
+					p.primitives = m_binRange.second - m_binRange.first;
+					p.pixels = (uint64_t)size.first * size.second; // clear
+					for (uint32_t i = m_binRange.first; i < m_binRange.second; i++)
+						p.pixels += boundedPixels(m_bins->primitives[bin[i]], tileBounds);
 				}
 			}
 		};
 
+		// Map line or triangle item of a Lines or Polygon element to raster coordinates and append it to the bins of
+		// the active tiles it overlaps
+		void binItem(const LinearMap2D& sceneToRaster, const Scene2D& scene, const Graphics2DElement& g, size_t item,
+			uint32_t segment, const RenderTileGrid& grid, FrameBins2D& frameBins) const {
+			if (g.content == Content2D::Lines) {
+				const auto& lines = scene.lines[g.idx];
+				const auto& line = lines.lines[item];
+				const float lineWidth = scene.materials[lines.material].linewidth;
+				RasterPrimitive2D primitive = { Content2D::Lines, (uint32_t)lines.material,
+					{ sceneToRaster.map(line.fst), sceneToRaster.map(line.snd) }, lineWidth, segment };
+				uint32_t primitiveIdx = (uint32_t)frameBins.primitives.size();
+				Span2f primitiveBounds = Span2f::Create(primitive.points[0], primitive.points[1]).expandSymmetric(strokeReach(lineWidth));
+				if (frameBins.append(primitiveIdx, primitiveBounds, grid))
+					frameBins.primitives.push_back(primitive);
+			}
+			else if (g.content == Content2D::Polygon) {
+				const auto& polygon = scene.polygons[g.idx];
+				const auto& points = polygon.polygon.points.points;
+				Pairf a = sceneToRaster.map(points[polygon.triangles[3 * item]]);
+				Pairf b = sceneToRaster.map(points[polygon.triangles[3 * item + 1]]);
+				Pairf c = sceneToRaster.map(points[polygon.triangles[3 * item + 2]]);
+				// rasterizer expects counterclockwise triangles in y-up raster coordinates
+				float area2 = (b - a).kross(c - a);
+				if (area2 == 0.f)
+					return;
+				if (area2 < 0.f)
+					std::swap(b, c);
+				RasterPrimitive2D primitive = { Content2D::Polygon, (uint32_t)polygon.material, { a, b, c }, 0.f, segment };
+				uint32_t primitiveIdx = (uint32_t)frameBins.primitives.size();
+				Span2f primitiveBounds = Span2f::Create(a, b).cover(c.x, c.y);
+				if (frameBins.append(primitiveIdx, primitiveBounds, grid))
+					frameBins.primitives.push_back(primitive);
+			}
+		}
+
+		// Map scene primitives to raster coordinates once and sort them into the bins of active tiles. Elements
+		// whose bounds do not touch any active tile are skipped.
+		void binScene(const LinearMap2D& sceneToRaster, const Scene2D& scene, const RenderTileGrid& grid,
+			const std::vector<std::vector<ElementBounds2D>>& elementBounds, FrameBins2D& frameBins) const {
+
+			// render layers front to back
+			uint32_t segment = 0;
+			for (size_t layerIdx = 0; layerIdx < scene.layers.size(); layerIdx++) {
+				while (layerIdx >= m_segments[segment].layerEnd)
+					segment++;
+				const auto& layer = scene.layers[layerIdx];
+				for (size_t elementIdx = 0; elementIdx < layer.graphics.size(); elementIdx++) {
+					const auto& g = layer.graphics[elementIdx];
+					const auto& bounds = elementBounds[layerIdx][elementIdx];
+					if (bounds.empty || (!bounds.everything && !frameBins.overlapsActive(bounds.span, grid)))
+						continue;
+
+					if (g.content == Content2D::Fill) {
+						uint32_t primitiveIdx = (uint32_t)frameBins.primitives.size();
+						frameBins.primitives.push_back({ Content2D::Fill, (uint32_t)g.idx, {}, 0.f, segment });
+						frameBins.appendToAll(primitiveIdx);
+					}
+					else if (g.content == Content2D::Lines) {
+						for (size_t i = 0; i < scene.lines[g.idx].lines.size(); i++)
+							binItem(sceneToRaster, scene, g, i, segment, grid, frameBins);
+					}
+					else if (g.content == Content2D::Polygon) {
+						for (size_t i = 0; 3 * i + 2 < scene.polygons[g.idx].triangles.size(); i++)
+							binItem(sceneToRaster, scene, g, i, segment, grid, frameBins);
+					}
+				}
+			}
+		}
+
+		// binScene for the items of a spatial index query, in painting order
+		void binSceneIndexed(const LinearMap2D& sceneToRaster, const Scene2D& scene, const RenderTileGrid& grid,
+			const std::vector<std::vector<ElementBounds2D>>& elementBounds, const Scene2DIndex& index,
+			const std::vector<uint32_t>& visibleItems, FrameBins2D& frameBins) const {
+
+			uint32_t segment = 0;
+			const Scene2DIndexItem* previous = nullptr;
+			bool skipElement = false;
+			for (uint32_t itemIdx : visibleItems) {
+				const auto& item = index.items()[itemIdx];
+				while (item.layer >= m_segments[segment].layerEnd)
+					segment++;
+				if (!previous || previous->layer != item.layer || previous->element != item.element) {
+					const auto& bounds = elementBounds[item.layer][item.element];
+					skipElement = bounds.empty || (!bounds.everything && !frameBins.overlapsActive(bounds.span, grid));
+				}
+				previous = &item;
+				if (skipElement)
+					continue;
+
+				const auto& g = scene.layers[item.layer].graphics[item.element];
+				if (g.content == Content2D::Fill) {
+					uint32_t primitiveIdx = (uint32_t)frameBins.primitives.size();
+					frameBins.primitives.push_back({ Content2D::Fill, (uint32_t)g.idx, {}, 0.f, segment });
+					frameBins.appendToAll(primitiveIdx);
+				}
+				else {
+					binItem(sceneToRaster, scene, g, item.item, segment, grid, frameBins);
+				}
+			}
+		}
+
+		// Activate the tiles touched by the old and new bounds of the elements changed since the previous frame,
+		// and update the element bounds. Return false if the whole frame must be re-rendered.
+		bool activateChangedTiles(const LinearMap2D& sceneToRaster, const Scene2D& scene, const RenderTileGrid& grid,
+			FrameBins2D& frameBins, std::vector<std::vector<ElementBounds2D>>& elementBounds) {
+
+			const auto& history = m_history;
+			if (!history.valid || history.generation != scene.generation.id() || !history.sameView(sceneToRaster, grid.origin)
+				|| history.elementBounds.size() != scene.layers.size())
+				return false;
+
+			std::vector<Scene2DChange> changes;
+			if (!scene.changesSince(history.version, changes))
+				return false;
+
+			elementBounds = std::move(m_history.elementBounds);
+			m_history.valid = false;
+
+			auto activate = [&](const ElementBounds2D& bounds) {
+				if (bounds.everything)
+					return false;
+				if (!bounds.empty)
+					frameBins.activate(bounds.span, grid);
+				return true;
+			};
+
+			for (const auto& change : changes) {
+				if (change.layer == Scene2DChange::AllLayers || change.layer >= scene.layers.size())
+					return false;
+				const auto& graphics = scene.layers[change.layer].graphics;
+				auto& layerBounds = elementBounds[change.layer];
+
+				if (change.element == Scene2DChange::AllElements) {
+					for (const auto& bounds : layerBounds) {
+						if (!activate(bounds)) return false;
+					}
+					layerBounds.clear();
+					for (const auto& g : graphics) {
+						layerBounds.push_back(ElementRasterBounds(sceneToRaster, scene, g));
+						if (!activate(layerBounds.back())) return false;
+					}
+				}
+				else {
+					if (change.element < layerBounds.size()) {
+						if (!activate(layerBounds[change.element])) return false;
+					}
+					if (change.element < graphics.size()) {
+						if (layerBounds.size() < graphics.size())
+							layerBounds.resize(graphics.size());
+						layerBounds[change.element] = ElementRasterBounds(sceneToRaster, scene, graphics[change.element]);
+						if (!activate(layerBounds[change.element])) return false;
+					}
+				}
+			}
+
+			// Structural changes that were not registered
+			for (size_t i = 0; i < scene.layers.size(); i++) {
+				if (elementBounds[i].size() != scene.layers[i].graphics.size())
+					return false;
+			}
+			return true;
+		}
+
 		//
 		// IRasterizer		
 		//
@@ -133,17 +650,125 @@ namespace dr4 {
 		virtual ~Rasterizer_vA(){}
 
 		virtual void draw2D(RasterConfig2D config, const Scene2D& scene, FrameTasks& tasks) override {
+			ProfileEvent event = { "draw2D", {} };
+			if (tasks.profile)
+				event.profile.startNs = ProfileClockNs();
+			const size_t segmentBuffersBefore = m_segmentBuffers.size();
+
 			// Split to as many subparts as wanted, then draw
-			std::shared_ptr<ITask> ptr(new DrawTask2D(config, scene, RenderTile::Full(m_buffer.width, m_buffer.height)));
-			tasks.tasks.push_back(ptr);
+			auto grid = RenderTileGrid::Create(m_buffer.width, m_buffer.height,
+				m_rasterizerConfig.tileWidth, m_rasterizerConfig.tileHeight, config.bufferOrigin);
+			const auto sceneToRaster = config.sceneToRaster();
+
+			// Tasks of the previous frame are normally freed by now, so their storage can be reused
+			m_taskArena.reset();
+			if (!m_frameBins || m_frameBins.use_count() > 1)
+				m_frameBins = std::make_shared<FrameBins2D>();
+			auto& frameBins = m_frameBins;
+			frameBins->primitives.clear();
+			frameBins->bins.resize(grid.tiles.size());
+			for (auto& bin : frameBins->bins)
+				bin.clear();
+			frameBins->activeTiles.assign(grid.tiles.size(), 0);
+			m_compositeLayers.clear();
+
+			// Content in view from the spatial index, when the scene has a current one
+			const Scene2DIndex* index = scene.index && scene.index->isCurrent(scene) ? scene.index.get() : nullptr;
+			std::vector<uint32_t> visibleItems;
+			if (index)
+				index->query(VisibleSceneSpan(config, scene, m_width, m_height), visibleItems);
+
+			// Re-render only the tiles affected by changes since the previous frame when possible
+			std::vector<std::vector<ElementBounds2D>> elementBounds;
+			if (!activateChangedTiles(sceneToRaster, scene, grid, *frameBins, elementBounds)) {
+				frameBins->activeTiles.assign(grid.tiles.size(), 1);
+				if (index) {
+					elementBounds = IndexedRasterBounds(sceneToRaster, scene, *index, visibleItems);
+				}
+				else {
+					elementBounds.clear();
+					for (const auto& layer : scene.layers) {
+						elementBounds.emplace_back();
+						for (const auto& g : layer.graphics)
+							elementBounds.back().push_back(ElementRasterBounds(sceneToRaster, scene, g));
+					}
+				}
+			}
+
+			m_segments = LayerSegment2D::Split(scene);
+			while (m_segmentBuffers.size() + 1 < m_segments.size())
+				m_segmentBuffers.emplace_back(m_buffer.width, m_buffer.height);
+
+			if (index)
+				binSceneIndexed(sceneToRaster, scene, grid, elementBounds, *index, visibleItems, *frameBins);
+			else
+				binScene(sceneToRaster, scene, grid, elementBounds, *frameBins);
+			std::shared_ptr<const FrameBins2D> bins = frameBins;
+			// At most a draw task per segment and a composite task per tile
+			tasks.tasks.reserve(tasks.tasks.size() + grid.tiles.size() * (m_segments.size() + 1));
+			for (size_t i = 0; i < grid.tiles.size(); i++) {
+				if (!bins->activeTiles[i])
+					continue;
+				const auto& tile = grid.tiles[i];
+				const auto& bin = bins->bins[i];
+
+				// Primitives of a segment are consecutive in the bin. The first segment clears the tile even if empty,
+				// other segments are rendered and composited only where they have primitives and are not transparent.
+				const size_t firstTask = tasks.tasks.size();
+				const size_t firstLayer = m_compositeLayers.size();
+				uint32_t begin = 0;
+				for (uint32_t segment = 0; segment < (uint32_t)m_segments.size(); segment++) {
+					uint32_t end = begin;
+					while (end < bin.size() && bins->primitives[bin[end]].segment == segment)
+						end++;
+					const bool visible = segment == 0 || (end > begin && m_segments[segment].opacity > 0.f);
+					if (visible) {
+						auto target = segment == 0 ? m_buffer.tileView(tile) : SegmentTileView(segment, tile);
+						auto task = m_taskArena.create<DrawTask2D>(bins, i, std::make_pair(begin, end), scene, tile, target);
+						task->setProfiling(tasks.profile);
+						tasks.tasks.push_back(std::move(task));
+						if (segment > 0)
+							m_compositeLayers.push_back({ target, m_segments[segment].opacity });
+					}
+					begin = end;
+				}
+				if (m_compositeLayers.size() > firstLayer) {
+					auto composite = m_taskArena.create<CompositeTask2D>(m_buffer.tileView(tile), m_compositeLayers,
+						std::make_pair(firstLayer, m_compositeLayers.size()));
+					for (size_t t = firstTask; t < tasks.tasks.size(); t++)
+						composite->addPredecessor(*tasks.tasks[t]);
+					composite->setProfiling(tasks.profile);
+					tasks.tasks.push_back(std::move(composite));
+				}
+			}
+
+			m_history.valid = m_rasterizerConfig.incremental;
+			m_history.generation = scene.generation.id();
+			m_history.version = scene.version;
+			m_history.sceneToRaster = sceneToRaster;
+			m_history.bufferOrigin = config.bufferOrigin;
+			m_history.elementBounds = std::move(elementBounds);
+
+			if (tasks.profile) {
+				// Binning memory of the frame and segment buffers created for it
+				size_t bytes = bins->primitives.capacity() * sizeof(RasterPrimitive2D);
+				for (const auto& bin : bins->bins)
+					bytes += bin.capacity() * sizeof(uint32_t);
+				bytes += (m_segmentBuffers.size() - segmentBuffersBefore) * (size_t)m_width * m_height * sizeof(Pixel);
+				event.profile.primitives = bins->primitives.size();
+				event.profile.bytesAllocated = bytes;
+				event.profile.threadId = std::hash<std::thread::id>()(std::this_thread::get_id());
+				event.profile.endNs = ProfileClockNs();
+				tasks.events.push_back(event);
+			}
+		}
+
+		virtual void invalidate() override {
+			m_history.valid = false;
 		}
 		
-		virtual void applyResult(FrameTasks& tasks) {
-			for (auto& t : tasks.tasks) {
-				DrawTask2D* taskIn = dynamic_cast<DrawTask2D*>(t.get());
-				// Apply buffer to buffer
-				m_buffer.apply(taskIn->m_buffer, taskIn->m_tile);
-			}
+		// Tiles are composited by the frame tasks, as soon as their segments are rendered
+		virtual void applyResult(FrameTasks&) override {
 		}
 
 		virtual ImageRGBA8SRGB getColorAsSRGB() const override {
@@ -154,5 +779,17 @@ namespace dr4 {
 }
 
 std::shared_ptr<dr4::IRasterizer> dr4::CreateRasterizer(unsigned width, unsigned height){
-	return std::make_shared<Rasterizer_vA>(width, height);
+	return std::make_shared<Rasterizer_vA<RGBAFloat32>>(width, height, RasterizerConfig::SingleTile());
+}
+
+std::shared_ptr<dr4::IRasterizer> dr4::CreateRasterizer(unsigned width, unsigned height, RasterizerConfig config){
+	switch (config.format) {
+	case RenderFormat::RGBA16FPremultiplied:
+		return std::make_shared<Rasterizer_vA<RGBAHalf16>>(width, height, config);
+	case RenderFormat::RGBA8Premultiplied:
+		return std::make_shared<Rasterizer_vA<SRGBA8Premultiplied>>(width, height, config);
+	case RenderFormat::RGBA32F:
+	default:
+		return std::make_shared<Rasterizer_vA<RGBAFloat32>>(width, height, config);
+	}
 }
@@ -184,6 +184,8 @@ dr4::Razz::DrawTriangle2(dr4::Painter& ptr, const RGBAFloat32& color1, float x1,
 	maxx = std::min((int)ptr.m_img.dim1() - 1, maxx);
 	maxy = std::min((int)ptr.m_img.dim2() - 1, maxy);
 
+	if (minx > maxx || miny > maxy) return;
+
 	float ex1 = x2 - x1;
 	float ey1 = y2 - y1;
 	
@@ -223,13 +225,13 @@ dr4::Razz::DrawTriangle3(dr4::Painter& ptr, const RGBAFloat32& color1, float x1,
 	miny = std::max(0, miny);
 	maxx = std::min((int)ptr.m_img.dim1() - 1, maxx);
 	maxy = std::min((int)ptr.m_img.dim2() - 1, maxy);
+	if (minx > maxx || miny > maxy) return;
+
 	unsigned umaxx = maxx;
 	unsigned umaxy = maxy;
 	unsigned y = miny;
 	unsigned x = minx;
 
-	if (x == umaxx || y == umaxy) return;
-
 	//float cy1 = F_IK(x1, y1, x2, y2, minx, miny);
 	//float cy2 = F_IK(x2, y2, x3, y3, minx, miny);
 	//float cy3 = F_IK(x3, y3, x1, y1, minx, miny);
@@ -257,57 +259,5 @@ dr4::Razz::DrawTriangle3(dr4::Painter& ptr, const RGBAFloat32& color1, float x1,
 }
 
 void dr4::Razz::DrawLine(Painter& ptr, RGBAFloat32 color, float x1, float y1, float x2, float y2) {
-	float xdiff = (x2 - x1);
-	float ydiff = (y2 - y1);
-
-	if (xdiff == 0.0f && ydiff == 0.0f) {
-		ptr.SetPixel(x1, y1, color);
-		return;
-	}
-
-	if (fabs(xdiff) > fabs(ydiff)) {
-		float xmin, xmax;
-
-		// set xmin to the lower x value given
-		// and xmax to the higher value
-		if (x1 < x2) {
-			xmin = x1;
-			xmax = x2;
-		}
-		else {
-			xmin = x2;
-			xmax = x1;
-		}
-
-		// draw line in terms of y slope
-		float slope = ydiff / xdiff;
-		for (float x = xmin; x <= xmax; x += 1.0f) {
-			float y = y1 + ((x - x1) * slope);
-			//Color color = color1 + ((color2 - color1) * ((x - x1) / xdiff));
-			ptr.SetPixel(x, y, color);
-		}
-	}
-	else {
-		float ymin, ymax;
-
-		// set ymin to the lower y value given
-		// and ymax to the higher value
-		if (y1 < y2) {
-			ymin = y1;
-			ymax = y2;
-		}
-		else {
-			ymin = y2;
-			ymax = y1;
-		}
-
-		// draw line in terms of x slope
-		float slope = xdiff / ydiff;
-		for (float y = ymin; y <= ymax; y += 1.0f) {
-			float x = x1 + ((y - y1) * slope);
-			//Color color = color1 + ((color2 - color1) * ((y - y1) / ydiff));
-			ptr.SetPixel(x, y, color);
-		}
-	}
-
+	DrawLineFixed(ptr, color, { x1, y1 }, { x2, y2 });
 }
@@ -0,0 +1,268 @@
+#include <dr4/dr4_rasterizer_algorithms.h>
+#include <dr4/dr4_parallel.h>
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#if defined(DR4_X86)
+#include <immintrin.h>
+#endif
+
+// Gradient fills.
+//
+// The gradient parameter is evaluated at pixel centers. Along a row only one quantity changes linearly, the parameter
+// itself for linear gradients and the x offset from the center for radial and conic gradients, so it is stepped from the
+// row start instead of being recomputed from the pixel position. The lookup table is resampled into channel planes and
+// interpolated linearly. Vector and scalar paths evaluate the same expressions, so the pixels of a row do not depend on
+// which path wrote them.
+
+namespace {
+
+	using dr4::RGBAFloat32;
+	using dr4::GradientShape;
+
+	const bool HasAVX2 = dr4::CpuFeatures::Get().avx2;
+	const float Pi = 3.14159274f;
+	const float HalfPi = 1.57079637f;
+	const float InvTwoPi = 0.159154943f;
+
+	// Lookup table samples in channel planes. The last sample is repeated so that interpolation can always read the
+	// sample after the integer position.
+	struct GradientRamp {
+		std::vector<float> c[4];
+		float start; // parameter of the first sample
+		float scale; // samples per unit of parameter
+		float last;  // position of the last sample
+
+		static GradientRamp Create(const dr4::LookUpTable<RGBAFloat32>& lut) {
+			GradientRamp ramp;
+			const auto& samples = lut.getData();
+			for (const auto& s : samples) {
+				ramp.c[0].push_back(s.r);
+				ramp.c[1].push_back(s.g);
+				ramp.c[2].push_back(s.b);
+				ramp.c[3].push_back(s.a);
+			}
+			for (auto& channel : ramp.c)
+				channel.push_back(channel.back());
+			const float length = lut.sourceEnd() - lut.sourceStart();
+			ramp.start = lut.sourceStart();
+			ramp.last = (float)(samples.size() - 1);
+			ramp.scale = length > 0.f ? ramp.last / length : 0.f;
+			return ramp;
+		}
+
+		RGBAFloat32 sample(float t) const {
+			float pos = (t - start) * scale;
+			if (!(pos > 0.f)) // NaN maps to the first sample
+				pos = 0.f;
+			pos = std::min(pos, last);
+			const size_t i = (size_t)pos;
+			const float f = pos - (float)i;
+			return { c[0][i] + (c[0][i + 1] - c[0][i]) * f, c[1][i] + (c[1][i + 1] - c[1][i]) * f,
+				c[2][i] + (c[2][i + 1] - c[2][i]) * f, c[3][i] + (c[3][i + 1] - c[3][i]) * f };
+		}
+	};
+
+	struct GradientSetup {
+		GradientShape shape;
+		float cx, cy;      // fst
+		float ax, ay;      // linear: t = (px - cx) * ax + (py - cy) * ay
+		float invRadius;   // radial: t = |p - c| * invRadius
+		float startAngle;  // conic: t = (angle(p - c) - startAngle) / 2pi, wrapped to [0, 1)
+
+		static GradientSetup Create(const dr4::GradientGeometry& g) {
+			GradientSetup s = { g.shape, g.fst.x, g.fst.y, 0.f, 0.f, 0.f, 0.f };
+			const float dx = g.snd.x - g.fst.x;
+			const float dy = g.snd.y - g.fst.y;
+			const float len2 = dx * dx + dy * dy;
+			if (len2 > 0.f) {
+				s.ax = dx / len2;
+				s.ay = dy / len2;
+				s.invRadius = 1.f / sqrtf(len2);
+			}
+			s.startAngle = atan2f(dy, dx);
+			return s;
+		}
+
+		// Value stepped along the row and its step per pixel
+		float rowStart(float px, float py) const {
+			return shape == GradientShape::Linear ? (px - cx) * ax + (py - cy) * ay : px - cx;
+		}
+		float rowStep() const {
+			return shape == GradientShape::Linear ? ax : 1.f;
+		}
+	};
+
+	// Polynomial atan2, absolute error below 1e-5 radians
+	inline float atan2Approx(float y, float x) {
+		const float ax = fabsf(x);
+		const float ay = fabsf(y);
+		const float a = std::min(ax, ay) / std::max(std::max(ax, ay), 1e-30f);
+		const float s = a * a;
+		float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+		if (ay > ax) r = HalfPi - r;
+		if (x < 0.f) r = Pi - r;
+		if (y < 0.f) r = -r;
+		return r;
+	}
+
+	// Gradient parameter from the stepped value v and the row offset dy from the center
+	inline float parameterAt(const GradientSetup& g, float v, float dy) {
+		switch (g.shape) {
+		case GradientShape::Radial:
+			return sqrtf(v * v + dy * dy) * g.invRadius;
+		case GradientShape::Conic: {
+			const float t = (atan2Approx(dy, v) - g.startAngle) * InvTwoPi;
+			return t - floorf(t);
+		}
+		case GradientShape::Linear:
+		default:
+			return v;
+		}
+	}
+
+	void fillRowScalar(const GradientSetup& g, const GradientRamp& ramp, RGBAFloat32* row, size_t begin, size_t end,
+		float v0, float step, float dy) {
+		for (size_t i = begin; i < end; i++) {
+			const float v = v0 + (float)i * step;
+			row[i] = dr4::BlendAlpha(ramp.sample(parameterAt(g, v, dy)), row[i]);
+		}
+	}
+
+#if defined(DR4_X86)
+	DR4_TARGET_AVX2
+	inline __m256 atan2ApproxAVX2(__m256 y, __m256 x) {
+		const __m256 signMask = _mm256_set1_ps(-0.f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 ax = _mm256_andnot_ps(signMask, x);
+		const __m256 ay = _mm256_andnot_ps(signMask, y);
+		const __m256 a = _mm256_div_ps(_mm256_min_ps(ax, ay), _mm256_max_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(1e-30f)));
+		const __m256 s = _mm256_mul_ps(a, a);
+		__m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_add_ps(
+			_mm256_mul_ps(_mm256_set1_ps(-0.0464964749f), s), _mm256_set1_ps(0.15931422f)), s), _mm256_set1_ps(0.327622764f)), s), a), a);
+		r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(HalfPi), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+		r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(Pi), r), _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+		r = _mm256_blendv_ps(r, _mm256_sub_ps(zero, r), _mm256_cmp_ps(y, zero, _CMP_LT_OQ));
+		return r;
+	}
+
+	DR4_TARGET_AVX2
+	inline __m256 parameterAtAVX2(const GradientSetup& g, __m256 v, float dy) {
+		switch (g.shape) {
+		case GradientShape::Radial: {
+			const __m256 dy2 = _mm256_set1_ps(dy * dy);
+			return _mm256_mul_ps(_mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(v, v), dy2)), _mm256_set1_ps(g.invRadius));
+		}
+		case GradientShape::Conic: {
+			const __m256 t = _mm256_mul_ps(_mm256_sub_ps(atan2ApproxAVX2(_mm256_set1_ps(dy), v), _mm256_set1_ps(g.startAngle)),
+				_mm256_set1_ps(InvTwoPi));
+			return _mm256_sub_ps(t, _mm256_floor_ps(t));
+		}
+		case GradientShape::Linear:
+		default:
+			return v;
+		}
+	}
+
+	DR4_TARGET_AVX2
+	inline __m256 rampChannelAVX2(const float* channel, __m256i i, __m256 f) {
+		const __m256 c0 = _mm256_i32gather_ps(channel, i, 4);
+		const __m256 c1 = _mm256_i32gather_ps(channel + 1, i, 4);
+		return _mm256_add_ps(c0, _mm256_mul_ps(_mm256_sub_ps(c1, c0), f));
+	}
+
+	// Eight pixels per step: gradient colors are computed in channel vectors, the destination pixels are transposed
+	// to channel vectors for the blend and back.
+	DR4_TARGET_AVX2
+	size_t fillRowAVX2(const GradientSetup& g, const GradientRamp& ramp, RGBAFloat32* row, size_t begin, size_t end,
+		float v0, float step, float dy) {
+		const __m256 lanes = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 rampStart = _mm256_set1_ps(ramp.start);
+		const __m256 rampScale = _mm256_set1_ps(ramp.scale);
+		const __m256 rampLast = _mm256_set1_ps(ramp.last);
+		const __m256 vStart = _mm256_set1_ps(v0);
+		const __m256 vStep = _mm256_set1_ps(step);
+		__m256 index = _mm256_add_ps(_mm256_set1_ps((float)begin), lanes);
+		size_t i = begin;
+		for (; i + 8 <= end; i += 8) {
+			const __m256 v = _mm256_add_ps(vStart, _mm256_mul_ps(index, vStep));
+			index = _mm256_add_ps(index, _mm256_set1_ps(8.f));
+			const __m256 t = parameterAtAVX2(g, v, dy);
+
+			// max returns the second operand for NaN, as the scalar sample maps NaN to the first sample
+			const __m256 pos = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(t, rampStart), rampScale), zero), rampLast);
+			const __m256i pi = _mm256_cvttps_epi32(pos);
+			const __m256 f = _mm256_sub_ps(pos, _mm256_cvtepi32_ps(pi));
+			const __m256 sr = rampChannelAVX2(ramp.c[0].data(), pi, f);
+			const __m256 sg = rampChannelAVX2(ramp.c[1].data(), pi, f);
+			const __m256 sb = rampChannelAVX2(ramp.c[2].data(), pi, f);
+			const __m256 sa = rampChannelAVX2(ramp.c[3].data(), pi, f);
+
+			float* dst = &row[i].r;
+			__m128 p0 = _mm_loadu_ps(dst), p1 = _mm_loadu_ps(dst + 4), p2 = _mm_loadu_ps(dst + 8), p3 = _mm_loadu_ps(dst + 12);
+			__m128 p4 = _mm_loadu_ps(dst + 16), p5 = _mm_loadu_ps(dst + 20), p6 = _mm_loadu_ps(dst + 24), p7 = _mm_loadu_ps(dst + 28);
+			_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+			_MM_TRANSPOSE4_PS(p4, p5, p6, p7);
+			const __m256 tr = _mm256_insertf128_ps(_mm256_castps128_ps256(p0), p4, 1);
+			const __m256 tg = _mm256_insertf128_ps(_mm256_castps128_ps256(p1), p5, 1);
+			const __m256 tb = _mm256_insertf128_ps(_mm256_castps128_ps256(p2), p6, 1);
+			const __m256 ta = _mm256_insertf128_ps(_mm256_castps128_ps256(p3), p7, 1);
+
+			// BlendAlpha
+			const __m256 fb = _mm256_sub_ps(one, sa);
+			const __m256 tafb = _mm256_mul_ps(ta, fb);
+			const __m256 a0 = _mm256_add_ps(sa, tafb);
+			const __m256 orr = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(sa, sr), _mm256_mul_ps(_mm256_mul_ps(ta, tr), fb)), a0);
+			const __m256 og = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(sa, sg), _mm256_mul_ps(_mm256_mul_ps(ta, tg), fb)), a0);
+			const __m256 ob = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(sa, sb), _mm256_mul_ps(_mm256_mul_ps(ta, tb), fb)), a0);
+
+			p0 = _mm256_castps256_ps128(orr); p4 = _mm256_extractf128_ps(orr, 1);
+			p1 = _mm256_castps256_ps128(og); p5 = _mm256_extractf128_ps(og, 1);
+			p2 = _mm256_castps256_ps128(ob); p6 = _mm256_extractf128_ps(ob, 1);
+			p3 = _mm256_castps256_ps128(a0); p7 = _mm256_extractf128_ps(a0, 1);
+			_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+			_MM_TRANSPOSE4_PS(p4, p5, p6, p7);
+			_mm_storeu_ps(dst, p0); _mm_storeu_ps(dst + 4, p1); _mm_storeu_ps(dst + 8, p2); _mm_storeu_ps(dst + 12, p3);
+			_mm_storeu_ps(dst + 16, p4); _mm_storeu_ps(dst + 20, p5); _mm_storeu_ps(dst + 24, p6); _mm_storeu_ps(dst + 28, p7);
+		}
+		return i;
+	}
+#endif
+}
+
+void dr4::FillGradient(ImageRGBA32LinearView image, const GradientGeometry& geometry, const LookUpTable<RGBAFloat32>& lut,
+	RasterDomain clip)
+{
+	if (lut.empty())
+		return;
+	auto area = clip.cropTo(RasterDomain::Create(image.dim1(), image.dim2()));
+	if (!area)
+		return;
+
+	const GradientRamp ramp = GradientRamp::Create(lut);
+	const GradientSetup setup = GradientSetup::Create(geometry);
+	const size_t x0 = area->origin.x;
+	const size_t x1 = x0 + area->width;
+	const float step = setup.rowStep();
+
+	// Rows are independent, bands of them are filled in parallel
+	parallelFor2D(area->width, area->height, ParallelGrain::Rows(), [&](const ParallelRange2D& band) {
+		for (size_t y = area->origin.y + band.y0; y < area->origin.y + band.y1; y++) {
+			// pixel x of the row is at v0 + x * step
+			const float py = (float)y + 0.5f;
+			const float v0 = setup.rowStart(0.5f, py);
+			const float dy = py - setup.cy;
+			RGBAFloat32* row = image.row(image.dim2() - y - 1);
+			size_t x = x0;
+#if defined(DR4_X86)
+			if (HasAVX2)
+				x = fillRowAVX2(setup, ramp, row, x0, x1, v0, step, dy);
+#endif
+			fillRowScalar(setup, ramp, row, x, x1, v0, step, dy);
+		}
+	});
+}
@@ -0,0 +1,213 @@
+#include <dr4/dr4_rasterizer_algorithms.h>
+#include <dr4/dr4_fixedpoint.h>
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+// Integer line rasterization.
+//
+// End points are snapped to sub-pixels in the coordinates of the full frame, as with triangles, so the pixels of a
+// line do not depend on the render tiling. One pixel is drawn for each column (or row, for steep lines) along the
+// major axis, at the minor axis position of the line at the pixel center. The line is clipped to the painter once,
+// after which the pixels are written without bounds checks.
+
+namespace {
+
+	using dr4::RGBAFloat32;
+	using dr4::Subpixel;
+
+	// Line with end points ordered along the major axis: a is the major and b the minor coordinate
+	struct LineSetup {
+		int64_t a0, b0;
+		int64_t a1, b1;
+		bool transposed; // major axis is y
+
+		int64_t da() const { return a1 - a0; }
+		int64_t db() const { return b1 - b0; }
+
+		// Minor axis pixel of major axis pixel c, the sample is clamped to the line end points
+		int64_t minorPixelAt(int64_t c) const {
+			int64_t a = std::min(std::max(Subpixel::Center(c), a0), a1);
+			return Subpixel::FloorDiv(b0 * da() + (a - a0) * db(), Subpixel::Scale * da());
+		}
+	};
+}
+
+template<class Pixel>
+void dr4::Razz::DrawLineFixed(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf fst, Pairf snd, int offsetx, int offsety)
+{
+	const Pixel pixel = PixelFormat<Pixel>::Encode(color);
+	const int64_t width = (int64_t)p.m_img.dim1();
+	const int64_t height = (int64_t)p.m_img.dim2();
+	const int64_t x0 = Subpixel::Snap(fst.x) - offsetx * Subpixel::Scale;
+	const int64_t y0 = Subpixel::Snap(fst.y) - offsety * Subpixel::Scale;
+	const int64_t x1 = Subpixel::Snap(snd.x) - offsetx * Subpixel::Scale;
+	const int64_t y1 = Subpixel::Snap(snd.y) - offsety * Subpixel::Scale;
+
+	LineSetup line;
+	line.transposed = std::llabs(y1 - y0) > std::llabs(x1 - x0);
+	if (line.transposed) {
+		line.a0 = y0; line.b0 = x0; line.a1 = y1; line.b1 = x1;
+	}
+	else {
+		line.a0 = x0; line.b0 = y0; line.a1 = x1; line.b1 = y1;
+	}
+	if (line.a0 > line.a1) {
+		std::swap(line.a0, line.a1);
+		std::swap(line.b0, line.b1);
+	}
+	const int64_t majorLimit = line.transposed ? height : width;
+	const int64_t minorLimit = line.transposed ? width : height;
+
+	auto plot = [&](int64_t c, int64_t r) {
+		if (line.transposed) p.row((unsigned)c)[r] = pixel;
+		else p.row((unsigned)r)[c] = pixel;
+	};
+
+	if (line.da() == 0) {
+		int64_t c = Subpixel::Pixel(line.a0);
+		int64_t r = Subpixel::Pixel(line.b0);
+		if (c >= 0 && c < majorLimit && r >= 0 && r < minorLimit)
+			plot(c, r);
+		return;
+	}
+
+	// The visible part of the line bounds the range of major axis pixels, lines completely outside cost nothing.
+	// The clipped range is widened by a pixel on both sides to cover float rounding.
+	const float scale = 1.f / (float)Subpixel::Scale;
+	auto clipped = RasterDomain::Create((size_t)width, (size_t)height).clipLine(
+		{ (float)x0 * scale, (float)y0 * scale }, { (float)x1 * scale, (float)y1 * scale });
+	if (!clipped)
+		return;
+	float clipLow = line.transposed ? clipped->first.y : clipped->first.x;
+	float clipHigh = line.transposed ? clipped->second.y : clipped->second.x;
+	if (clipLow > clipHigh)
+		std::swap(clipLow, clipHigh);
+
+	int64_t cFirst = std::max({ Subpixel::Pixel(line.a0), (int64_t)std::floor(clipLow) - 1, (int64_t)0 });
+	int64_t cLast = std::min({ Subpixel::Pixel(line.a1), (int64_t)std::floor(clipHigh) + 1, majorLimit - 1 });
+
+	// The minor coordinate is monotonic along the line, so trimming the ends leaves only pixels inside
+	auto minorInside = [&](int64_t c) {
+		int64_t r = line.minorPixelAt(c);
+		return r >= 0 && r < minorLimit;
+	};
+	while (cFirst <= cLast && !minorInside(cFirst)) cFirst++;
+	while (cLast >= cFirst && !minorInside(cLast)) cLast--;
+	if (cFirst > cLast)
+		return;
+
+	// Pixels whose centers are outside the end points sample at the end point
+	int64_t c = cFirst;
+	for (; c <= cLast && Subpixel::Center(c) < line.a0; c++)
+		plot(c, line.minorPixelAt(c));
+	int64_t cInteriorLast = cLast;
+	while (cInteriorLast >= c && Subpixel::Center(cInteriorLast) > line.a1)
+		cInteriorLast--;
+
+	// DDA: minor = floor(n / d) is stepped with an integer quotient and remainder
+	if (c <= cInteriorLast) {
+		const int64_t d = Subpixel::Scale * line.da();
+		const int64_t n = line.b0 * line.da() + (Subpixel::Center(c) - line.a0) * line.db();
+		int64_t q = Subpixel::FloorDiv(n, d);
+		int64_t r = n - q * d;
+		const int64_t step = Subpixel::Scale * line.db(); // |step| <= d as |db| <= da
+		const int64_t stepq = Subpixel::FloorDiv(step, d);
+		const int64_t stepr = step - stepq * d;
+		for (; c <= cInteriorLast; c++) {
+			plot(c, q);
+			q += stepq;
+			r += stepr;
+			if (r >= d) {
+				r -= d;
+				q++;
+			}
+		}
+	}
+
+	for (; c <= cLast; c++)
+		plot(c, line.minorPixelAt(c));
+}
+
+template<class Pixel>
+void dr4::Razz::DrawStroke(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf fst, Pairf snd, float width, int offsetx, int offsety)
+{
+	const float halfWidth = 0.5f * width;
+	if (!(halfWidth > 0.f) || !(color.a > 0.f))
+		return;
+
+	// Coverage falls off linearly over one pixel across the stroke boundary, so pixels closer than
+	// this to the segment are touched
+	const float reach = halfWidth + 0.5f;
+
+	// Pixel centers are evaluated in frame coordinates, which keeps coverage identical across tiles
+	const float originx = (float)offsetx + 0.5f;
+	const float originy = (float)offsety + 0.5f;
+
+	// Expanded bounding box in painter pixels
+	const int painterWidth = (int)p.m_img.dim1();
+	const int painterHeight = (int)p.m_img.dim2();
+	const float bx0 = std::min(fst.x, snd.x) - reach - originx;
+	const float bx1 = std::max(fst.x, snd.x) + reach - originx;
+	const float by0 = std::min(fst.y, snd.y) - reach - originy;
+	const float by1 = std::max(fst.y, snd.y) + reach - originy;
+	if (!(bx1 >= 0.f && by1 >= 0.f && bx0 <= (float)(painterWidth - 1) && by0 <= (float)(painterHeight - 1)))
+		return;
+	const int miny = std::max(0, (int)std::ceil(by0));
+	const int maxy = std::min(painterHeight - 1, (int)std::floor(by1));
+
+	const Pairf seg = snd - fst;
+	const Pixel src = PixelFormat<Pixel>::Encode(color);
+	// Coverage of a row is computed and blended in chunks, so strokes do not allocate
+	const int CoverageChunk = 256;
+	float coverage[CoverageChunk];
+
+	const float segLength2 = seg.dot(seg);
+	const float invSegLength2 = segLength2 > 0.f ? 1.f / segLength2 : 0.f;
+	const float invdy = seg.y != 0.f ? 1.f / seg.y : 0.f;
+
+	for (int y = miny; y <= maxy; y++) {
+		const float cy = originy + (float)y;
+
+		// The segment part within reach of the row limits the columns to evaluate
+		float t0 = 0.f;
+		float t1 = 1.f;
+		if (seg.y != 0.f) {
+			float ta = (cy - reach - fst.y) * invdy;
+			float tb = (cy + reach - fst.y) * invdy;
+			t0 = std::max(t0, std::min(ta, tb));
+			t1 = std::min(t1, std::max(ta, tb));
+			if (t0 > t1)
+				continue;
+		}
+		float xa = fst.x + seg.x * t0;
+		float xb = fst.x + seg.x * t1;
+		const int minx = std::max(0, (int)std::ceil(std::min(xa, xb) - reach - originx));
+		const int maxx = std::min(painterWidth - 1, (int)std::floor(std::max(xa, xb) + reach - originx));
+
+		if (minx > maxx)
+			continue;
+
+		for (int x0 = minx; x0 <= maxx; x0 += CoverageChunk) {
+			const int x1 = std::min(maxx, x0 + CoverageChunk - 1);
+			for (int x = x0; x <= x1; x++) {
+				// distance to the segment as in LineDistance2D::unsignedDistance
+				Pairf pa = { originx + (float)x - fst.x, cy - fst.y };
+				float h = clampf(pa.dot(seg) * invSegLength2, 0.f, 1.f);
+				Pairf d = pa - seg * h;
+				coverage[x - x0] = clampf(reach - d.norm(), 0.f, 1.f);
+			}
+			PixelFormat<Pixel>::BlendSpan(p.row((unsigned)y) + x0, coverage, (size_t)(x1 - x0 + 1), src);
+		}
+	}
+}
+
+#define DR4_INSTANTIATE_LINE_KERNELS(Pixel_) \
+	template void dr4::Razz::DrawLineFixed<Pixel_>(PainterT<Pixel_>&, const RGBAFloat32&, Pairf, Pairf, int, int); \
+	template void dr4::Razz::DrawStroke<Pixel_>(PainterT<Pixel_>&, const RGBAFloat32&, Pairf, Pairf, float, int, int);
+
+DR4_INSTANTIATE_LINE_KERNELS(dr4::RGBAFloat32)
+DR4_INSTANTIATE_LINE_KERNELS(dr4::RGBAHalf16)
+DR4_INSTANTIATE_LINE_KERNELS(dr4::SRGBA8Premultiplied)
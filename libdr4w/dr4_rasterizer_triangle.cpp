@@ -0,0 +1,387 @@
+#include <dr4/dr4_rasterizer_algorithms.h>
+#include <dr4/dr4_cpu.h>
+#include <dr4/dr4_fixedpoint.h>
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#if defined(DR4_X86)
+#include <immintrin.h>
+#endif
+
+// Halfspace triangle rasterization with fixed point edge functions.
+//
+// Vertices are snapped to a grid of 1/16 pixel. Pixels are sampled at their centers and pixels on shared edges
+// are assigned with the top-left rule, so triangles sharing an edge cover each pixel exactly once.
+// Snapping is done in the coordinates of the full frame before the (integer) painter offset is subtracted,
+// which makes the coverage independent of the render tiling.
+//
+// Large triangles are traversed in 8x8 pixel blocks classified by the edge functions at the block corners:
+// covered blocks are filled as spans, blocks outside are skipped and only partially covered blocks are
+// evaluated per pixel.
+
+namespace {
+
+	using dr4::RGBAFloat32;
+
+	const int64_t SubpixelScale = dr4::Subpixel::Scale;
+	const int64_t SubpixelHalf = dr4::Subpixel::Half;
+
+	// E(x, y) = A * x + B * y + C, where x and y are in subpixel units and E >= 0 inside the triangle
+	struct EdgeFunction {
+		int64_t A;
+		int64_t B;
+		int64_t C;
+
+		static EdgeFunction Create(int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+			EdgeFunction e;
+			e.A = y0 - y1;
+			e.B = x1 - x0;
+			e.C = -(e.A * x0 + e.B * y0);
+			// Top-left rule for counterclockwise triangles in y-up coordinates: samples exactly on a top or
+			// left edge are inside, samples on other edges are biased out
+			bool top = (y0 == y1) && (x1 < x0);
+			bool left = y1 < y0;
+			if (!(top || left))
+				e.C -= 1;
+			return e;
+		}
+
+		int64_t at(int64_t x, int64_t y) const { return A * x + B * y + C; }
+	};
+
+	struct TriangleSetup {
+		EdgeFunction edges[3];
+		int64_t stepx[3]; // change of the edge functions from a pixel to the next one in x
+		int64_t stepy[3]; // and in y
+		int minx, miny, maxx, maxy; // pixel bounding box clipped to the painter, y-up
+	};
+
+	// Returns false if the triangle is degenerate or does not touch the painter area
+	bool setupTriangle(TriangleSetup& setup, size_t width, size_t height, dr4::Pairf a, dr4::Pairf b, dr4::Pairf c, int offsetx, int offsety) {
+		int64_t ox = (int64_t)offsetx * SubpixelScale;
+		int64_t oy = (int64_t)offsety * SubpixelScale;
+		int64_t x0 = dr4::Subpixel::Snap(a.x) - ox, y0 = dr4::Subpixel::Snap(a.y) - oy;
+		int64_t x1 = dr4::Subpixel::Snap(b.x) - ox, y1 = dr4::Subpixel::Snap(b.y) - oy;
+		int64_t x2 = dr4::Subpixel::Snap(c.x) - ox, y2 = dr4::Subpixel::Snap(c.y) - oy;
+
+		int64_t area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+		if (area == 0)
+			return false;
+		if (area < 0) {
+			std::swap(x1, x2);
+			std::swap(y1, y2);
+		}
+
+		setup.edges[0] = EdgeFunction::Create(x0, y0, x1, y1);
+		setup.edges[1] = EdgeFunction::Create(x1, y1, x2, y2);
+		setup.edges[2] = EdgeFunction::Create(x2, y2, x0, y0);
+		for (int i = 0; i < 3; i++) {
+			setup.stepx[i] = setup.edges[i].A * SubpixelScale;
+			setup.stepy[i] = setup.edges[i].B * SubpixelScale;
+		}
+
+		// Pixel px has its sample at px * 16 + 8
+		auto firstPixel = [](int64_t v) { return (int64_t)std::ceil((double)(v - SubpixelHalf) / SubpixelScale); };
+		auto lastPixel = [](int64_t v) { return (int64_t)std::floor((double)(v - SubpixelHalf) / SubpixelScale); };
+
+		int64_t minx = std::max<int64_t>(0, firstPixel(std::min(std::min(x0, x1), x2)));
+		int64_t miny = std::max<int64_t>(0, firstPixel(std::min(std::min(y0, y1), y2)));
+		int64_t maxx = std::min<int64_t>((int64_t)width - 1, lastPixel(std::max(std::max(x0, x1), x2)));
+		int64_t maxy = std::min<int64_t>((int64_t)height - 1, lastPixel(std::max(std::max(y0, y1), y2)));
+		if (minx > maxx || miny > maxy)
+			return false;
+
+		setup.minx = (int)minx; setup.miny = (int)miny;
+		setup.maxx = (int)maxx; setup.maxy = (int)maxy;
+		return true;
+	}
+
+	inline int64_t sampleCoordinate(int pixel) { return dr4::Subpixel::Center(pixel); }
+
+	// Edge function values at the sample of pixel (x, y). Traversals evaluate these once and then step them.
+	void edgeValues(const TriangleSetup& s, int x, int y, int64_t w[3]) {
+		const int64_t sx = sampleCoordinate(x);
+		const int64_t sy = sampleCoordinate(y);
+		for (int i = 0; i < 3; i++)
+			w[i] = s.edges[i].at(sx, sy);
+	}
+
+	// Triangles are convex, so the covered pixels of a row, or of any part of a row, form a single span.
+	// The span finders return the covered span of a row between columns xa and xb, or false if there is none.
+	// w holds the edge function values at the sample of column xa.
+
+	bool findSpanScalar(const TriangleSetup& s, const int64_t w[3], int xa, int xb, int& xstart, int& xend) {
+		int64_t w0 = w[0], w1 = w[1], w2 = w[2];
+		const int64_t d0 = s.stepx[0], d1 = s.stepx[1], d2 = s.stepx[2];
+
+		int x = xa;
+		while ((w0 | w1 | w2) < 0) {
+			if (++x > xb)
+				return false;
+			w0 += d0; w1 += d1; w2 += d2;
+		}
+		xstart = x;
+		do {
+			x++;
+			w0 += d0; w1 += d1; w2 += d2;
+		} while (x <= xb && (w0 | w1 | w2) >= 0);
+		xend = x - 1;
+		return true;
+	}
+
+	// The vector kernels evaluate edge functions in 32 bits. This is exact if every value inside the
+	// bounding box, and the per step increments, fit.
+	bool fitsInt32(const TriangleSetup& s, int lanes) {
+		const int64_t limit = INT32_MAX;
+		int64_t xs[2] = { sampleCoordinate(s.minx), sampleCoordinate(s.maxx) };
+		int64_t ys[2] = { sampleCoordinate(s.miny), sampleCoordinate(s.maxy) };
+		for (const auto& e : s.edges) {
+			if (std::llabs(e.A) * SubpixelScale * lanes > limit)
+				return false;
+			for (int64_t x : xs) for (int64_t y : ys) {
+				int64_t v = e.at(x, y);
+				if (v > limit || v < -limit) return false;
+			}
+		}
+		return true;
+	}
+
+#if defined(DR4_X86)
+	// Index of the lowest and highest set bit of a lane mask
+	inline int lowestLane(int mask) { int i = 0; while (!(mask & (1 << i))) i++; return i; }
+	inline int highestLane(int mask) { int i = 31; while (!(mask & (1 << i))) i--; return i; }
+
+	// Updates the covered span of a row from the lane mask of a group starting at x. Returns true when the
+	// span is known to be complete.
+	inline bool accumulateSpan(int inside, int fullMask, int x, int& xstart, int& xend) {
+		if (!inside)
+			return xstart >= 0;
+		if (xstart < 0)
+			xstart = x + lowestLane(inside);
+		xend = x + highestLane(inside);
+		// the span continues to the next group only through the last lane
+		return (inside & (fullMask ^ (fullMask >> 1))) == 0;
+	}
+
+	bool findSpanSSE2(const TriangleSetup& s, const int64_t w0[3], int xa, int xb, int& xstart, int& xend) {
+		__m128i w[3], step[3];
+		for (int i = 0; i < 3; i++) {
+			int32_t dx = (int32_t)s.stepx[i];
+			// SSE2 has no 32 bit multiply, so the lane offsets are set up directly
+			w[i] = _mm_add_epi32(_mm_set1_epi32((int32_t)w0[i]), _mm_setr_epi32(0, dx, 2 * dx, 3 * dx));
+			step[i] = _mm_set1_epi32(4 * dx);
+		}
+
+		xstart = -1;
+		xend = -1;
+		for (int x = xa; x <= xb; x += 4) {
+			// sign bit set in any edge function means the sample is outside
+			int outside = _mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(_mm_or_si128(w[0], w[1]), w[2])));
+			int valid = xb - x + 1;
+			int inside = (~outside) & (valid >= 4 ? 0xF : ((1 << valid) - 1));
+			if (accumulateSpan(inside, 0xF, x, xstart, xend))
+				break;
+			for (int i = 0; i < 3; i++)
+				w[i] = _mm_add_epi32(w[i], step[i]);
+		}
+		return xstart >= 0;
+	}
+
+	DR4_TARGET_AVX2
+	bool findSpanAVX2(const TriangleSetup& s, const int64_t w0[3], int xa, int xb, int& xstart, int& xend) {
+		const __m256i laneIdx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		__m256i w[3], step[3];
+		for (int i = 0; i < 3; i++) {
+			int32_t dx = (int32_t)s.stepx[i];
+			w[i] = _mm256_add_epi32(_mm256_set1_epi32((int32_t)w0[i]), _mm256_mullo_epi32(laneIdx, _mm256_set1_epi32(dx)));
+			step[i] = _mm256_set1_epi32(8 * dx);
+		}
+
+		xstart = -1;
+		xend = -1;
+		for (int x = xa; x <= xb; x += 8) {
+			int outside = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_or_si256(w[0], w[1]), w[2])));
+			int valid = xb - x + 1;
+			int inside = (~outside) & (valid >= 8 ? 0xFF : ((1 << valid) - 1));
+			if (accumulateSpan(inside, 0xFF, x, xstart, xend))
+				break;
+			for (int i = 0; i < 3; i++)
+				w[i] = _mm256_add_epi32(w[i], step[i]);
+		}
+		return xstart >= 0;
+	}
+
+#endif
+
+	typedef bool (*FindSpanFun)(const TriangleSetup&, const int64_t*, int, int, int&, int&);
+
+	// Span finder for the given instruction set. The vector span finders need 32 bit edge functions.
+	// They are only used when asked for explicitly, see DrawTriangleFixed.
+	FindSpanFun selectFindSpan(const TriangleSetup& s, dr4::SimdLevel level) {
+#if defined(DR4_X86)
+		if (level == dr4::SimdLevel::AVX2 && fitsInt32(s, 8))
+			return findSpanAVX2;
+		if (level != dr4::SimdLevel::Scalar && fitsInt32(s, 4))
+			return findSpanSSE2;
+#endif
+		return findSpanScalar;
+	}
+
+	template<class Pixel>
+	void drawTriangleRows(dr4::PainterT<Pixel>& p, const Pixel& pixel, const TriangleSetup& s, dr4::SimdLevel level) {
+		FindSpanFun findSpan = selectFindSpan(s, level);
+		int64_t w[3];
+		edgeValues(s, s.minx, s.miny, w);
+		int xstart, xend;
+		for (int y = s.miny; y <= s.maxy; y++) {
+			if (findSpan(s, w, s.minx, s.maxx, xstart, xend))
+				dr4::PixelFormat<Pixel>::FillSpan(p.row(y) + xstart, xend - xstart + 1, pixel);
+			for (int i = 0; i < 3; i++)
+				w[i] += s.stepy[i];
+		}
+	}
+
+	const int BlockSize = 8;
+
+	enum class BlockCoverage { Outside, Partial, Inside };
+
+	// Edge functions are linear, so their extremes over a block are at the corner samples. w holds the edge
+	// function values at the top-left sample of a block spanning columns + 1 by rows + 1 pixels.
+	BlockCoverage classifyBlock(const TriangleSetup& s, const int64_t w[3], int columns, int rows) {
+		bool inside = true;
+		for (int i = 0; i < 3; i++) {
+			const int64_t dx = columns * s.stepx[i];
+			const int64_t dy = rows * s.stepy[i];
+			const int64_t cmax = w[i] + std::max<int64_t>(dx, 0) + std::max<int64_t>(dy, 0);
+			const int64_t cmin = w[i] + std::min<int64_t>(dx, 0) + std::min<int64_t>(dy, 0);
+			if (cmax < 0)
+				return BlockCoverage::Outside;
+			if (cmin < 0)
+				inside = false;
+		}
+		return inside ? BlockCoverage::Inside : BlockCoverage::Partial;
+	}
+
+	template<class Pixel>
+	void drawTriangleBlocks(dr4::PainterT<Pixel>& p, const Pixel& pixel, const TriangleSetup& s, dr4::SimdLevel level) {
+		FindSpanFun findSpan = selectFindSpan(s, level);
+		auto fillSpan = [&](int y, int xstart, int xend) {
+			dr4::PixelFormat<Pixel>::FillSpan(p.row(y) + xstart, xend - xstart + 1, pixel);
+		};
+
+		// Edge function values at the top-left sample of the current block row and block, stepped per block
+		int64_t blockRow[3];
+		edgeValues(s, s.minx, s.miny, blockRow);
+		int64_t blockStepx[3], blockStepy[3];
+		for (int i = 0; i < 3; i++) {
+			blockStepx[i] = BlockSize * s.stepx[i];
+			blockStepy[i] = BlockSize * s.stepy[i];
+		}
+
+		for (int by = s.miny; by <= s.maxy; by += BlockSize) {
+			const int y1 = std::min(by + BlockSize - 1, s.maxy);
+			int64_t block[3] = { blockRow[0], blockRow[1], blockRow[2] };
+
+			// Horizontally adjacent covered blocks are merged into one run of span fills
+			int runStart = -1;
+			int runEnd = -1;
+			auto flushRun = [&]() {
+				if (runStart < 0) return;
+				for (int y = by; y <= y1; y++)
+					fillSpan(y, runStart, runEnd);
+				runStart = -1;
+			};
+
+			for (int bx = s.minx; bx <= s.maxx; bx += BlockSize) {
+				const int x1 = std::min(bx + BlockSize - 1, s.maxx);
+				BlockCoverage coverage = classifyBlock(s, block, x1 - bx, y1 - by);
+				if (coverage == BlockCoverage::Inside) {
+					if (runStart < 0) runStart = bx;
+					runEnd = x1;
+				}
+				else {
+					flushRun();
+					if (coverage == BlockCoverage::Partial) {
+						int64_t w[3] = { block[0], block[1], block[2] };
+						int xstart, xend;
+						for (int y = by; y <= y1; y++) {
+							if (findSpan(s, w, bx, x1, xstart, xend))
+								fillSpan(y, xstart, xend);
+							for (int i = 0; i < 3; i++)
+								w[i] += s.stepy[i];
+						}
+					}
+				}
+				for (int i = 0; i < 3; i++)
+					block[i] += blockStepx[i];
+			}
+			flushRun();
+			for (int i = 0; i < 3; i++)
+				blockRow[i] += blockStepy[i];
+		}
+	}
+}
+
+template<class Pixel>
+void dr4::Razz::DrawTriangleFixed(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf a, Pairf b, Pairf c,
+	int offsetx, int offsety, SimdLevel level)
+{
+	TriangleSetup setup;
+	if (!setupTriangle(setup, p.m_img.dim1(), p.m_img.dim2(), a, b, c, offsetx, offsety))
+		return;
+
+	// never run instructions the processor does not have
+	level = std::min(level, CpuFeatures::Get().bestSimdLevel());
+	const Pixel pixel = PixelFormat<Pixel>::Encode(color);
+
+	// Block classification pays off once the bounding box spans many blocks in both directions. Measured on
+	// triangles of a fixed bounding box, blocks break even with rows at about 64 to 96 pixels and win from 128.
+	const int blockThreshold = 16 * BlockSize;
+	if (setup.maxx - setup.minx >= blockThreshold && setup.maxy - setup.miny >= blockThreshold)
+		drawTriangleBlocks(p, pixel, setup, level);
+	else
+		drawTriangleRows(p, pixel, setup, level);
+}
+
+template<class Pixel>
+void dr4::Razz::DrawTriangleFixed(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf a, Pairf b, Pairf c,
+	int offsetx, int offsety)
+{
+	// The vector span finders measure slower than scalar in test/bench: spans of typical triangles are too
+	// short to amortize the lane setup
+	DrawTriangleFixed(p, color, a, b, c, offsetx, offsety, SimdLevel::Scalar);
+}
+
+template<class Pixel>
+void dr4::Razz::DrawTriangleHierarchical(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf a, Pairf b, Pairf c,
+	int offsetx, int offsety, SimdLevel level)
+{
+	TriangleSetup setup;
+	if (!setupTriangle(setup, p.m_img.dim1(), p.m_img.dim2(), a, b, c, offsetx, offsety))
+		return;
+	level = std::min(level, CpuFeatures::Get().bestSimdLevel());
+	drawTriangleBlocks(p, PixelFormat<Pixel>::Encode(color), setup, level);
+}
+
+template<class Pixel>
+void dr4::Razz::DrawTriangleScanline(PainterT<Pixel>& p, const RGBAFloat32& color, Pairf a, Pairf b, Pairf c,
+	int offsetx, int offsety, SimdLevel level)
+{
+	TriangleSetup setup;
+	if (!setupTriangle(setup, p.m_img.dim1(), p.m_img.dim2(), a, b, c, offsetx, offsety))
+		return;
+	level = std::min(level, CpuFeatures::Get().bestSimdLevel());
+	drawTriangleRows(p, PixelFormat<Pixel>::Encode(color), setup, level);
+}
+
+#define DR4_INSTANTIATE_TRIANGLE_KERNELS(Pixel_) \
+	template void dr4::Razz::DrawTriangleFixed<Pixel_>(PainterT<Pixel_>&, const RGBAFloat32&, Pairf, Pairf, Pairf, int, int); \
+	template void dr4::Razz::DrawTriangleFixed<Pixel_>(PainterT<Pixel_>&, const RGBAFloat32&, Pairf, Pairf, Pairf, int, int, SimdLevel); \
+	template void dr4::Razz::DrawTriangleHierarchical<Pixel_>(PainterT<Pixel_>&, const RGBAFloat32&, Pairf, Pairf, Pairf, int, int, SimdLevel); \
+	template void dr4::Razz::DrawTriangleScanline<Pixel_>(PainterT<Pixel_>&, const RGBAFloat32&, Pairf, Pairf, Pairf, int, int, SimdLevel);
+
+DR4_INSTANTIATE_TRIANGLE_KERNELS(dr4::RGBAFloat32)
+DR4_INSTANTIATE_TRIANGLE_KERNELS(dr4::RGBAHalf16)
+DR4_INSTANTIATE_TRIANGLE_KERNELS(dr4::SRGBA8Premultiplied)
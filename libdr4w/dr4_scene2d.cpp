@@ -1,3 +1,81 @@
 #include <dr4/dr4_scene2d.h>
 
+#include <mapbox/earcut.hpp>
 
+#include <algorithm>
+#include <atomic>
+
+namespace mapbox {
+	namespace util {
+		template <>
+		struct nth<0, dr4::Pairf> {
+			inline static float get(const dr4::Pairf& p) { return p.x; };
+		};
+		template <>
+		struct nth<1, dr4::Pairf> {
+			inline static float get(const dr4::Pairf& p) { return p.y; };
+		};
+	}
+}
+
+std::vector<uint32_t> dr4::TriangulatePolygon(const Polygon2D& polygon) {
+	// earcut takes the outer ring followed by optional hole rings
+	std::vector<std::vector<Pairf>> rings = { polygon.points.points };
+	return mapbox::earcut<uint32_t>(rings);
+}
+
+dr4::PolygonFill2D dr4::PolygonFill2D::Create(const Polygon2D& polygon, size_t material) {
+	PolygonFill2D fill;
+	fill.polygon = polygon;
+	fill.material = material;
+	fill.triangles = TriangulatePolygon(polygon);
+	return fill;
+}
+
+uint64_t dr4::Scene2DGeneration::Next() {
+	static std::atomic<uint64_t> next = 1;
+	return next++;
+}
+
+void dr4::Scene2D::logChange(const Scene2DChange& change) {
+	changeLog.push_back(change);
+	// Drop the older half, renderers further behind render a full frame
+	if (changeLog.size() > MaxChangeLog)
+		trimChangeLog(changeLog[changeLog.size() - MaxChangeLog / 2 - 1].version);
+}
+
+void dr4::Scene2D::markChanged(size_t layer, size_t element) {
+	version++;
+	layers[layer].version = version;
+	if (element < layers[layer].graphics.size())
+		layers[layer].graphics[element].version = version;
+	logChange({ version, layer, element });
+}
+
+void dr4::Scene2D::markLayerChanged(size_t layer) {
+	version++;
+	layers[layer].version = version;
+	logChange({ version, layer, Scene2DChange::AllElements });
+}
+
+void dr4::Scene2D::markAllChanged() {
+	version++;
+	logChange({ version, Scene2DChange::AllLayers, Scene2DChange::AllElements });
+}
+
+bool dr4::Scene2D::changesSince(uint64_t fromVersion, std::vector<Scene2DChange>& out) const {
+	if (fromVersion < changeLogStart || fromVersion > version)
+		return false;
+	auto first = std::upper_bound(changeLog.begin(), changeLog.end(), fromVersion,
+		[](uint64_t v, const Scene2DChange& change) { return v < change.version; });
+	out.insert(out.end(), first, changeLog.end());
+	return true;
+}
+
+void dr4::Scene2D::trimChangeLog(uint64_t upToVersion) {
+	upToVersion = std::min(upToVersion, version);
+	auto last = std::upper_bound(changeLog.begin(), changeLog.end(), upToVersion,
+		[](uint64_t v, const Scene2DChange& change) { return v < change.version; });
+	changeLog.erase(changeLog.begin(), last);
+	changeLogStart = std::max(changeLogStart, upToVersion);
+}
@@ -0,0 +1,155 @@
+#include <dr4/dr4_scene2d_index.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// Upper limit of grid cells, items are spread to about two per cell below it
+	const size_t MaxCells = size_t(1) << 20;
+	// Items covering more cells are not placed in the grid but returned by every query, which bounds the grid
+	// memory for long lines and large triangles
+	const size_t MaxCellsPerItem = 64;
+
+	// Cell containing coordinate v along one axis, clamped to the grid
+	size_t CellOf(float v, float origin, float cellSize, size_t count) {
+		const float f = (v - origin) / cellSize;
+		return f <= 0.f ? 0 : std::min(count - 1, (size_t)f);
+	}
+}
+
+std::shared_ptr<const dr4::Scene2DIndex> dr4::Scene2DIndex::Build(const Scene2D& scene) {
+	auto index = std::make_shared<Scene2DIndex>();
+	index->m_generation = scene.generation.id();
+	index->m_version = scene.version;
+
+	// Items and their scene space bounds in painting order
+	std::vector<Span2f> itemBounds;
+	bool empty = true;
+	auto addItem = [&](uint32_t layer, uint32_t element, uint32_t item, const Span2f& bounds) {
+		index->m_items.push_back({ layer, element, item });
+		itemBounds.push_back(bounds);
+		index->m_bounds = empty ? bounds : index->m_bounds.cover(bounds);
+		empty = false;
+	};
+
+	for (uint32_t layerIdx = 0; layerIdx < (uint32_t)scene.layers.size(); layerIdx++) {
+		const auto& graphics = scene.layers[layerIdx].graphics;
+		index->m_layerSizes.push_back(graphics.size());
+		for (uint32_t elementIdx = 0; elementIdx < (uint32_t)graphics.size(); elementIdx++) {
+			const auto& g = graphics[elementIdx];
+			if (g.content == Content2D::Fill) {
+				index->m_unbounded.push_back((uint32_t)index->m_items.size());
+				index->m_items.push_back({ layerIdx, elementIdx, 0 });
+				itemBounds.push_back({});
+			}
+			else if (g.content == Content2D::Lines) {
+				const auto& lines = scene.lines[g.idx].lines;
+				for (uint32_t i = 0; i < (uint32_t)lines.size(); i++)
+					addItem(layerIdx, elementIdx, i, Span2f::Create(lines[i].fst, lines[i].snd));
+			}
+			else if (g.content == Content2D::Polygon) {
+				const auto& polygon = scene.polygons[g.idx];
+				const auto& points = polygon.polygon.points.points;
+				for (uint32_t i = 0; 3 * i + 2 < (uint32_t)polygon.triangles.size(); i++) {
+					const Pairf& c = points[polygon.triangles[3 * i + 2]];
+					addItem(layerIdx, elementIdx, i,
+						Span2f::Create(points[polygon.triangles[3 * i]], points[polygon.triangles[3 * i + 1]]).cover(c.x, c.y));
+				}
+			}
+		}
+	}
+
+	const size_t gridItems = index->m_items.size() - index->m_unbounded.size();
+	if (gridItems == 0)
+		return index;
+
+	// Cells roughly square in scene space
+	const float width = std::max(index->m_bounds.x.length(), 1e-6f);
+	const float height = std::max(index->m_bounds.y.length(), 1e-6f);
+	const size_t cells = std::clamp<size_t>(gridItems / 2, 1, MaxCells);
+	index->m_columns = std::clamp<size_t>((size_t)std::lround(std::sqrt((float)cells * width / height)), 1, cells);
+	index->m_rows = std::max<size_t>(1, cells / index->m_columns);
+	index->m_cellWidth = width / (float)index->m_columns;
+	index->m_cellHeight = height / (float)index->m_rows;
+
+	// Items placed in the grid, the rest are unbounded
+	std::vector<bool> inGrid(index->m_items.size(), true);
+	for (uint32_t i : index->m_unbounded)
+		inGrid[i] = false;
+
+	// Count items per cell, then place them
+	std::vector<size_t> counts(index->m_columns * index->m_rows + 1, 0);
+	auto forEachCell = [&](const Span2f& span, auto&& fun) {
+		const size_t c0 = CellOf(span.x.min, index->m_bounds.x.min, index->m_cellWidth, index->m_columns);
+		const size_t c1 = CellOf(span.x.max, index->m_bounds.x.min, index->m_cellWidth, index->m_columns);
+		const size_t r0 = CellOf(span.y.min, index->m_bounds.y.min, index->m_cellHeight, index->m_rows);
+		const size_t r1 = CellOf(span.y.max, index->m_bounds.y.min, index->m_cellHeight, index->m_rows);
+		if ((c1 - c0 + 1) * (r1 - r0 + 1) > MaxCellsPerItem)
+			return false;
+		for (size_t r = r0; r <= r1; r++) {
+			for (size_t c = c0; c <= c1; c++)
+				fun(r * index->m_columns + c);
+		}
+		return true;
+	};
+	for (size_t i = 0; i < index->m_items.size(); i++) {
+		if (inGrid[i] && !forEachCell(itemBounds[i], [&](size_t cell) { counts[cell + 1]++; })) {
+			inGrid[i] = false;
+			index->m_unbounded.push_back((uint32_t)i);
+		}
+	}
+	std::sort(index->m_unbounded.begin(), index->m_unbounded.end());
+	for (size_t i = 1; i < counts.size(); i++)
+		counts[i] += counts[i - 1];
+	index->m_cellStart = counts;
+	index->m_cellItems.resize(counts.back());
+
+	for (size_t i = 0; i < index->m_items.size(); i++) {
+		if (inGrid[i])
+			forEachCell(itemBounds[i], [&](size_t cell) { index->m_cellItems[counts[cell]++] = (uint32_t)i; });
+	}
+	return index;
+}
+
+bool dr4::Scene2DIndex::isCurrent(const Scene2D& scene) const {
+	if (m_generation != scene.generation.id() || m_version != scene.version || m_layerSizes.size() != scene.layers.size())
+		return false;
+	for (size_t i = 0; i < m_layerSizes.size(); i++) {
+		if (m_layerSizes[i] != scene.layers[i].graphics.size())
+			return false;
+	}
+	return true;
+}
+
+void dr4::Scene2DIndex::query(const Span2f& span, std::vector<uint32_t>& out) const {
+	const size_t begin = out.size();
+	out.insert(out.end(), m_unbounded.begin(), m_unbounded.end());
+
+	if (m_columns > 0 && span.x.min <= m_bounds.x.max && span.x.max >= m_bounds.x.min
+		&& span.y.min <= m_bounds.y.max && span.y.max >= m_bounds.y.min) {
+
+		if (span.x.min <= m_bounds.x.min && span.x.max >= m_bounds.x.max
+			&& span.y.min <= m_bounds.y.min && span.y.max >= m_bounds.y.max) {
+			// Everything is visible, no need to visit the cells
+			out.resize(begin);
+			for (uint32_t i = 0; i < (uint32_t)m_items.size(); i++)
+				out.push_back(i);
+			return;
+		}
+
+		const size_t c0 = CellOf(span.x.min, m_bounds.x.min, m_cellWidth, m_columns);
+		const size_t c1 = CellOf(span.x.max, m_bounds.x.min, m_cellWidth, m_columns);
+		const size_t r0 = CellOf(span.y.min, m_bounds.y.min, m_cellHeight, m_rows);
+		const size_t r1 = CellOf(span.y.max, m_bounds.y.min, m_cellHeight, m_rows);
+		for (size_t r = r0; r <= r1; r++) {
+			for (size_t c = c0; c <= c1; c++) {
+				const size_t cellIdx = r * m_columns + c;
+				out.insert(out.end(), m_cellItems.begin() + m_cellStart[cellIdx], m_cellItems.begin() + m_cellStart[cellIdx + 1]);
+			}
+		}
+	}
+
+	// Items spanning several cells are found more than once
+	std::sort(out.begin() + begin, out.end());
+	out.erase(std::unique(out.begin() + begin, out.end()), out.end());
+}
@@ -1,21 +1,128 @@
 
 #include <dr4/dr4_task.h>
+#include <dr4/dr4_threadpool.h>
 
-#include <execution>
 #include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+// Tasks of a future and a last task, depending on all of them, that calls the continuations
+class dr4::TaskFutureState {
+public:
+	class CompletionTask : public ITask {
+	public:
+		TaskFutureState* m_state = nullptr;
+		virtual const char* name() const override { return "TaskFuture"; }
+		virtual void doTask() override { m_state->complete(); }
+	};
+
+	ThreadPool* m_pool = nullptr; // null when run by SequentialExecutor
+	TaskGroup m_group;
+	ITask::Collection m_tasks;
+	ITask* m_completion = nullptr; // last of m_tasks
+	std::mutex m_mutex;
+	bool m_completed = false;
+	std::vector<std::function<void()>> m_continuations;
+
+	explicit TaskFutureState(ITask::Collection tasks) :m_tasks(std::move(tasks)) {
+		auto completion = std::make_shared<CompletionTask>();
+		completion->m_state = this;
+		for (auto& task : m_tasks)
+			completion->addPredecessor(*task);
+		m_completion = completion.get();
+		m_tasks.push_back(completion);
+	}
+
+	void complete() {
+		std::vector<std::function<void()>> continuations;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_completed = true;
+			continuations.swap(m_continuations);
+		}
+		for (auto& fun : continuations)
+			fun();
+	}
+};
+
+bool dr4::TaskFuture::isReady() const {
+	return m_state && m_state->m_completion->isDone();
+}
+
+void dr4::TaskFuture::wait() const {
+	if (m_state && m_state->m_pool)
+		m_state->m_pool->wait(m_state->m_group);
+}
+
+void dr4::TaskFuture::then(std::function<void()> fun) const {
+	if (!m_state)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_state->m_mutex);
+		if (!m_state->m_completed) {
+			m_state->m_continuations.push_back(std::move(fun));
+			return;
+		}
+	}
+	fun();
+}
+
+int64_t dr4::ProfileClockNs() {
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void dr4::ITask::run() {
+	if (m_profiling) {
+		m_profile.threadId = std::hash<std::thread::id>()(std::this_thread::get_id());
+		m_profile.startNs = ProfileClockNs();
+		doTask();
+		m_profile.endNs = ProfileClockNs();
+	}
+	else {
+		doTask();
+	}
+	done();
+}
 
 void dr4::SequentialExecutor::runBlock(ITask::Collection& tasks) {
-	using namespace std;
-	for_each(tasks.begin(), tasks.end(), [](shared_ptr<ITask>& task) {
-		task->doTask();
-		task->done();
-	});
+	// Tasks in collection order, except that successors wait for their predecessors
+	std::vector<ITask*> ready;
+	for (auto& task : tasks)
+		task->m_waitingFor = task->m_predecessorCount;
+	for (auto task = tasks.rbegin(); task != tasks.rend(); task++) {
+		if ((*task)->m_predecessorCount == 0)
+			ready.push_back(task->get());
+	}
+	while (!ready.empty()) {
+		ITask* task = ready.back();
+		ready.pop_back();
+		task->run();
+		for (size_t i = task->successorCount(); i-- > 0;) {
+			ITask* successor = task->successor(i);
+			if (--successor->m_waitingFor == 0)
+				ready.push_back(successor);
+		}
+	}
 }
 
+dr4::TaskFuture dr4::SequentialExecutor::submit(ITask::Collection tasks) {
+	auto state = std::make_shared<TaskFutureState>(std::move(tasks));
+	runBlock(state->m_tasks);
+	return TaskFuture(state);
+}
+
+dr4::ParallelExecutor::ParallelExecutor() :m_pool(&ThreadPool::Global()) {}
+
 void dr4::ParallelExecutor::runBlock(ITask::Collection& tasks) {
-	using namespace std;
-	for_each(execution::par, tasks.begin(), tasks.end(), [](shared_ptr<ITask>& task) {
-		task->doTask();
-		task->done();
-	});
+	m_pool->runBlock(tasks);
+}
+
+dr4::TaskFuture dr4::ParallelExecutor::submit(ITask::Collection tasks) {
+	auto state = std::make_shared<TaskFutureState>(std::move(tasks));
+	state->m_pool = m_pool;
+	// The pool keeps the state alive until the tasks are done, even if the future is dropped
+	m_pool->submit(state->m_tasks, state->m_group, state);
+	return TaskFuture(state);
 }
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include <dr4/dr4_taskarena.h>
+
+#include <algorithm>
+#include <cstdint>
+
+void* dr4::TaskArena::Blocks::allocate(size_t bytes, size_t alignment) {
+	for (;;) {
+		if (block < blocks.size()) {
+			uintptr_t base = (uintptr_t)blocks[block].get();
+			size_t aligned = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+			if (aligned + bytes <= blockSizes[block]) {
+				offset = aligned + bytes;
+				return (void*)(base + aligned);
+			}
+			// Continue in the next block, if there is one left from a previous frame
+			if (block + 1 < blocks.size()) {
+				block++;
+				offset = 0;
+				continue;
+			}
+		}
+		const size_t size = std::max(blockSize, bytes + alignment);
+		blocks.emplace_back(new uint8_t[size]);
+		blockSizes.push_back(size);
+		heapAllocations++;
+		block = blocks.size() - 1;
+		offset = 0;
+	}
+}
+
+void dr4::TaskArena::reset() {
+	if (m_blocks->refs == 1) {
+		m_blocks->block = 0;
+		m_blocks->offset = 0;
+		return;
+	}
+	m_retiredHeapAllocations += m_blocks->heapAllocations;
+	Blocks* blocks = new Blocks(m_blocks->blockSize);
+	Release(m_blocks);
+	m_blocks = blocks;
+}
@@ -0,0 +1,247 @@
+#include <dr4/dr4_threadpool.h>
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+	// Pool and queue of the current thread if it is a pool worker
+	thread_local dr4::ThreadPool* t_pool = nullptr;
+	thread_local size_t t_queue = 0;
+
+	std::mutex g_globalMutex;
+	dr4::ThreadPoolConfig g_globalConfig;
+	bool g_globalStarted = false;
+
+	void PinThread(std::thread& thread, size_t processor) {
+#if defined(_WIN32)
+		SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << (processor % (8 * sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET((int)(processor % CPU_SETSIZE), &set);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+		(void)thread;
+		(void)processor;
+#endif
+	}
+
+	// Task calling fun for one index of parallelFor
+	class IndexTask : public dr4::ITask {
+	public:
+		const std::function<void(size_t)>* fun = nullptr;
+		size_t index = 0;
+		virtual const char* name() const override { return "ParallelFor"; }
+		virtual void doTask() override { (*fun)(index); }
+	};
+}
+
+dr4::ThreadPool::ThreadPool(ThreadPoolConfig config) {
+	const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+	const size_t workers = config.workers == ThreadPoolConfig::Auto ? hardware - 1 : config.workers;
+	// Without workers the waiting threads run everything from a single queue
+	for (size_t i = 0; i < std::max<size_t>(1, workers); i++)
+		m_queues.push_back(std::make_unique<Queue>());
+	for (size_t i = 0; i < workers; i++) {
+		m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+		if (config.pinThreads)
+			PinThread(m_threads.back(), i % hardware);
+	}
+}
+
+dr4::ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto& t : m_threads)
+		t.join();
+}
+
+dr4::ThreadPool& dr4::ThreadPool::Global() {
+	static ThreadPool pool([]() {
+		std::lock_guard<std::mutex> lock(g_globalMutex);
+		g_globalStarted = true;
+		return g_globalConfig;
+	}());
+	return pool;
+}
+
+bool dr4::ThreadPool::ConfigureGlobal(ThreadPoolConfig config) {
+	std::lock_guard<std::mutex> lock(g_globalMutex);
+	if (g_globalStarted)
+		return false;
+	g_globalConfig = config;
+	return true;
+}
+
+size_t dr4::ThreadPool::submitQueue() {
+	if (t_pool == this)
+		return t_queue;
+	return m_nextQueue++ % m_queues.size();
+}
+
+void dr4::ThreadPool::push(const Job& job, size_t queueIdx) {
+	Queue& queue = *m_queues[queueIdx];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	queue.jobs.push_back(job);
+	m_queued++;
+}
+
+void dr4::ThreadPool::submitTasks(size_t count, const std::function<ITask*(size_t)>& task, TaskGroup& group,
+	std::shared_ptr<void> owner) {
+	// Successors are queued by their last predecessor, see runJob
+	size_t roots = 0;
+	for (size_t i = 0; i < count; i++) {
+		ITask* t = task(i);
+		t->m_waitingFor = t->m_predecessorCount;
+		roots += t->m_predecessorCount == 0;
+	}
+	if (roots == 0)
+		return;
+	if (owner)
+		group.m_owner = owner;
+	group.m_pending += roots;
+	const size_t first = submitQueue();
+	const bool spread = t_pool != this;
+	for (size_t i = 0, queued = 0; i < count; i++) {
+		ITask* t = task(i);
+		if (t->m_predecessorCount == 0)
+			push({ t, &group }, spread ? (first + queued++) % m_queues.size() : first);
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	if (roots == 1)
+		m_wake.notify_one();
+	else
+		m_wake.notify_all();
+}
+
+void dr4::ThreadPool::submit(ITask* task, TaskGroup& group) {
+	submitTasks(1, [task](size_t) { return task; }, group);
+}
+
+void dr4::ThreadPool::submit(ITask::Collection& tasks, TaskGroup& group) {
+	submitTasks(tasks.size(), [&tasks](size_t i) { return tasks[i].get(); }, group);
+}
+
+void dr4::ThreadPool::submit(ITask::Collection& tasks, TaskGroup& group, std::shared_ptr<void> owner) {
+	submitTasks(tasks.size(), [&tasks](size_t i) { return tasks[i].get(); }, group, owner);
+}
+
+void dr4::ThreadPool::runJob(const Job& job) {
+	// The group is alive until this task leaves it, after that only the owner keeps it alive
+	std::shared_ptr<void> owner = job.group->m_owner;
+	job.task->run();
+	// Successors join the group before the task leaves it, so the group is not done in between
+	for (size_t i = 0; i < job.task->successorCount(); i++) {
+		ITask* successor = job.task->successor(i);
+		if (--successor->m_waitingFor == 0) {
+			job.group->m_pending++;
+			push({ successor, job.group }, submitQueue());
+			{
+				std::lock_guard<std::mutex> lock(m_sleepMutex);
+			}
+			m_wake.notify_one();
+		}
+	}
+	if (--job.group->m_pending == 0) {
+		if (owner)
+			job.group->m_owner.reset();
+		// Waiters check the group under the lock, so the notification cannot fall between their check and wait
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_wake.notify_all();
+	}
+}
+
+bool dr4::ThreadPool::tryRunOne(size_t ownQueue) {
+	if (m_queued == 0)
+		return false;
+	const size_t count = m_queues.size();
+	for (size_t k = 0; k < count; k++) {
+		const size_t idx = (ownQueue + k) % count;
+		Queue& queue = *m_queues[idx];
+		Job job;
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.jobs.empty())
+				continue;
+			// Own queue is used as a stack for locality, other queues are stolen from the other end
+			if (k == 0 && t_pool == this) {
+				job = queue.jobs.back();
+				queue.jobs.pop_back();
+			}
+			else {
+				job = queue.jobs.front();
+				queue.jobs.pop_front();
+			}
+			m_queued--;
+		}
+		runJob(job);
+		return true;
+	}
+	return false;
+}
+
+void dr4::ThreadPool::workerLoop(size_t workerIdx) {
+	t_pool = this;
+	t_queue = workerIdx;
+	for (;;) {
+		if (tryRunOne(workerIdx))
+			continue;
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this]() { return m_stop || m_queued > 0; });
+		if (m_stop)
+			return;
+	}
+}
+
+void dr4::ThreadPool::wait(TaskGroup& group) {
+	const size_t ownQueue = t_pool == this ? t_queue : m_nextQueue++ % m_queues.size();
+	while (!group.isDone()) {
+		if (tryRunOne(ownQueue))
+			continue;
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this, &group]() { return group.isDone() || m_queued > 0; });
+	}
+}
+
+void dr4::ThreadPool::runBlock(ITask::Collection& tasks) {
+	if (tasks.size() == 1 && tasks[0]->m_predecessorCount == 0) {
+		tasks[0]->run();
+		return;
+	}
+	TaskGroup group;
+	submit(tasks, group);
+	wait(group);
+}
+
+void dr4::ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fun) {
+	if (count == 0)
+		return;
+	if (count == 1) {
+		fun(0);
+		return;
+	}
+	std::unique_ptr<IndexTask[]> tasks(new IndexTask[count]);
+	for (size_t i = 0; i < count; i++) {
+		tasks[i].fun = &fun;
+		tasks[i].index = i;
+	}
+	TaskGroup group;
+	submitTasks(count, [&tasks](size_t i) { return &tasks[i]; }, group);
+	wait(group);
+}
@@ -4,7 +4,19 @@
 #include <dr4/dr4_floatingpoint.h>
 
 #include <dr4/dr4_handlemanager.h>
+#include <dr4/dr4_image_planar.h>
+#include <dr4/dr4_json_parser.h>
+#include <dr4/dr4_parallel.h>
+#include <dr4/dr4_rasterizer_algorithms.h>
+#include <dr4/dr4_rand.h>
+#include <dr4/dr4_scene2d.h>
+#include <dr4/dr4_scene2d_index.h>
+#include <dr4/dr4_taskarena.h>
+#include <dr4/dr4_threadpool.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <string>
 
 TEST(DR4Test, TestDistanceLine) {
@@ -130,4 +142,781 @@ TEST(DR4Test, TestHandles) {
 			ASSERT_EQ(*s, r.first);
 	}
 
-}
\ No newline at end of file
+}
+
+TEST(DR4Test, TestTriangleFixedSharedEdges) {
+
+	using namespace dr4;
+	const size_t w = 67;
+	const size_t h = 53;
+	const RGBAFloat32 one = { 1.f, 0.f, 0.f, 0.f };
+
+	// Fan of triangles around an interior point, including axis aligned and subpixel placed edges
+	Pairf center = { 31.3f, 27.5f };
+	Pairf rim[] = { {0.f, 0.f}, {20.25f, 0.f}, {67.f, 0.f}, {67.f, 30.f}, {67.f, 53.f},
+		{40.f, 53.f}, {0.f, 53.f}, {0.f, 26.0625f} };
+	const size_t rimCount = sizeof(rim) / sizeof(rim[0]);
+
+	Array2D<int> coverage(w, h, 0);
+	for (size_t i = 0; i < rimCount; i++) {
+		ImageRGBA32Linear img(w, h, { 0.f, 0.f, 0.f, 0.f });
+		Painter painter(img);
+		Razz::DrawTriangleFixed(painter, one, center, rim[i], rim[(i + 1) % rimCount], 0, 0, SimdLevel::Scalar);
+		for (size_t y = 0; y < h; y++)
+			for (size_t x = 0; x < w; x++)
+				coverage.set(x, y, coverage.at(x, y) + (int)img.at(x, y).r);
+	}
+
+	// the fan covers the whole image, every pixel must be drawn exactly once
+	for (size_t y = 0; y < h; y++)
+		for (size_t x = 0; x < w; x++)
+			ASSERT_EQ(coverage.at(x, y), 1) << x << "," << y;
+}
+
+TEST(DR4Test, TestTriangleFixedSimdMatchesScalar) {
+
+	using namespace dr4;
+	const size_t w = 97;
+	const size_t h = 61;
+	const RGBAFloat32 color = { 0.25f, 0.5f, 0.75f, 1.f };
+
+	// vertices on a 1/8 pixel grid from -20 to 120 so that samples often fall exactly on edges
+	RandIntGenerator gen;
+	auto coord = [&]() { return -20.f + (float)((uint64_t)gen.next() % 1121) / 8.f; };
+	SimdLevel levels[] = { SimdLevel::SSE2, SimdLevel::AVX2 };
+	for (int i = 0; i < 200; i++) {
+		Pairf a = { coord(), coord() };
+		Pairf b = { coord(), coord() };
+		Pairf c = { coord(), coord() };
+
+		ImageRGBA32Linear reference(w, h, { 0.f, 0.f, 0.f, 0.f });
+		Painter referencePainter(reference);
+		Razz::DrawTriangleFixed(referencePainter, color, a, b, c, 3, 5, SimdLevel::Scalar);
+
+		for (SimdLevel level : levels) {
+			if (level == SimdLevel::AVX2 && !CpuFeatures::Get().avx2)
+				continue;
+			ImageRGBA32Linear img(w, h, { 0.f, 0.f, 0.f, 0.f });
+			Painter painter(img);
+			Razz::DrawTriangleFixed(painter, color, a, b, c, 3, 5, level);
+			for (size_t y = 0; y < h; y++)
+				for (size_t x = 0; x < w; x++)
+					ASSERT_EQ(img.at(x, y).r, reference.at(x, y).r) << SimdLevelToString(level) << " " << i;
+		}
+	}
+}
+
+TEST(DR4Test, TestTriangleHierarchicalMatchesScanline) {
+
+	using namespace dr4;
+	const size_t w = 301;
+	const size_t h = 203;
+	const RGBAFloat32 color = { 1.f, 0.5f, 0.25f, 1.f };
+
+	// large triangles partially outside the image, on a 1/8 pixel grid
+	RandIntGenerator gen;
+	auto coord = [&]() { return -100.f + (float)((uint64_t)gen.next() % 4001) / 8.f; };
+	SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+	for (int i = 0; i < 100; i++) {
+		Pairf a = { coord(), coord() };
+		Pairf b = { coord(), coord() };
+		Pairf c = { coord(), coord() };
+
+		ImageRGBA32Linear reference(w, h, { 0.f, 0.f, 0.f, 0.f });
+		Painter referencePainter(reference);
+		Razz::DrawTriangleScanline(referencePainter, color, a, b, c, 0, 0, SimdLevel::Scalar);
+
+		for (SimdLevel level : levels) {
+			ImageRGBA32Linear img(w, h, { 0.f, 0.f, 0.f, 0.f });
+			Painter painter(img);
+			Razz::DrawTriangleHierarchical(painter, color, a, b, c, 0, 0, level);
+			for (size_t y = 0; y < h; y++)
+				for (size_t x = 0; x < w; x++)
+					ASSERT_EQ(img.at(x, y).r, reference.at(x, y).r) << SimdLevelToString(level) << " " << i;
+		}
+	}
+}
+
+TEST(DR4Test, TestClipLine) {
+
+	using namespace dr4;
+	RasterDomain domain = RasterDomain::Create(100, 50);
+
+	auto inside = domain.clipLine({ 10.f, 10.f }, { 20.f, 30.f });
+	ASSERT_TRUE(inside.has_value());
+	EXPECT_FLOAT_EQ(inside->first.x, 10.f);
+	EXPECT_FLOAT_EQ(inside->second.y, 30.f);
+
+	auto crossing = domain.clipLine({ -50.f, 25.f }, { 150.f, 25.f });
+	ASSERT_TRUE(crossing.has_value());
+	EXPECT_FLOAT_EQ(crossing->first.x, 0.f);
+	EXPECT_FLOAT_EQ(crossing->second.x, 100.f);
+	EXPECT_FLOAT_EQ(crossing->first.y, 25.f);
+
+	auto diagonal = domain.clipLine({ -10.f, -10.f }, { 90.f, 90.f });
+	ASSERT_TRUE(diagonal.has_value());
+	EXPECT_FLOAT_EQ(diagonal->first.x, 0.f);
+	EXPECT_FLOAT_EQ(diagonal->first.y, 0.f);
+	EXPECT_FLOAT_EQ(diagonal->second.x, 50.f);
+	EXPECT_FLOAT_EQ(diagonal->second.y, 50.f);
+
+	EXPECT_FALSE(domain.clipLine({ -10.f, 60.f }, { 200.f, 60.f }).has_value());
+	EXPECT_FALSE(domain.clipLine({ 90.f, -30.f }, { 130.f, 10.f }).has_value());
+}
+
+TEST(DR4Test, TestLineFixedClippingIsTranslationInvariant) {
+
+	using namespace dr4;
+	const size_t w = 211;
+	const size_t h = 157;
+	const RGBAFloat32 color = { 1.f, 1.f, 1.f, 1.f };
+
+	// lines drawn to a window of the full image must match the full image
+	const int offsetx = 70;
+	const int offsety = 40;
+	const size_t windoww = 53;
+	const size_t windowh = 47;
+
+	RandIntGenerator gen;
+	auto coord = [&]() { return -50.f + (float)((uint64_t)gen.next() % 2481) / 8.f; };
+	for (int i = 0; i < 200; i++) {
+		Pairf a = { coord(), coord() };
+		Pairf b = { coord(), coord() };
+
+		ImageRGBA32Linear full(w, h, { 0.f, 0.f, 0.f, 0.f });
+		Painter fullPainter(full);
+		Razz::DrawLineFixed(fullPainter, color, a, b);
+
+		ImageRGBA32Linear window(windoww, windowh, { 0.f, 0.f, 0.f, 0.f });
+		Painter windowPainter(window);
+		Razz::DrawLineFixed(windowPainter, color, a, b, offsetx, offsety);
+
+		// images are stored top row first
+		for (size_t y = 0; y < windowh; y++)
+			for (size_t x = 0; x < windoww; x++)
+				ASSERT_EQ(window.at(x, y).r, full.at(x + offsetx, y + (h - windowh - offsety)).r) << i;
+	}
+}
+
+TEST(DR4Test, TestStrokeCoverage) {
+
+	using namespace dr4;
+	const size_t w = 40;
+	const size_t h = 30;
+	ImageRGBA32Linear img(w, h, { 0.f, 0.f, 0.f, 0.f });
+	Painter painter(img);
+
+	// horizontal stroke 4 pixels wide centered on y = 15 covers rows 13..16 fully
+	Razz::DrawStroke(painter, { 1.f, 1.f, 1.f, 1.f }, { 10.f, 15.f }, { 30.f, 15.f }, 4.f);
+
+	auto alphaAt = [&](size_t x, size_t y) { return img.at(x, h - y - 1).a; };
+	for (size_t y = 13; y <= 16; y++)
+		EXPECT_FLOAT_EQ(alphaAt(20, y), 1.f) << y;
+	EXPECT_FLOAT_EQ(alphaAt(20, 12), 0.f);
+	EXPECT_FLOAT_EQ(alphaAt(20, 17), 0.f);
+	// round caps
+	EXPECT_FLOAT_EQ(alphaAt(9, 15), 1.f);
+	EXPECT_GT(alphaAt(8, 15), 0.f);
+	EXPECT_LT(alphaAt(8, 15), 1.f);
+	EXPECT_FLOAT_EQ(alphaAt(6, 15), 0.f);
+
+	// pixel centers exactly on the edge of a 3 pixel wide stroke are half covered
+	ImageRGBA32Linear img3(w, h, { 0.f, 0.f, 0.f, 0.f });
+	Painter painter3(img3);
+	Razz::DrawStroke(painter3, { 1.f, 1.f, 1.f, 1.f }, { 10.f, 15.f }, { 30.f, 15.f }, 3.f);
+	EXPECT_FLOAT_EQ(img3.at(20, h - 13 - 1).a, 0.5f);
+	EXPECT_FLOAT_EQ(img3.at(20, h - 15 - 1).a, 1.f);
+	EXPECT_FLOAT_EQ(img3.at(20, h - 16 - 1).a, 0.5f);
+}
+
+TEST(DR4Test, TestSceneChangeLog) {
+
+	using namespace dr4;
+	Scene2DBuilder builder;
+	size_t layer = builder.addLayer();
+	builder.add(layer, ColorFill::CreateDefault());
+	builder.add(layer, ColorFill::CreateDefault());
+	Scene2D scene = builder.build();
+
+	uint64_t v0 = scene.version;
+	scene.markChanged(layer, 1);
+	scene.markLayerChanged(layer);
+	EXPECT_EQ(scene.version, v0 + 2);
+	EXPECT_EQ(scene.layers[layer].version, scene.version);
+	EXPECT_EQ(scene.layers[layer].graphics[1].version, v0 + 1);
+	EXPECT_EQ(scene.layers[layer].graphics[0].version, 0u);
+
+	std::vector<Scene2DChange> changes;
+	ASSERT_TRUE(scene.changesSince(v0, changes));
+	ASSERT_EQ(changes.size(), 2u);
+	EXPECT_EQ(changes[0].element, 1u);
+	EXPECT_EQ(changes[1].element, Scene2DChange::AllElements);
+
+	changes.clear();
+	ASSERT_TRUE(scene.changesSince(v0 + 1, changes));
+	EXPECT_EQ(changes.size(), 1u);
+
+	// trimmed versions are no longer covered
+	scene.trimChangeLog(v0 + 1);
+	changes.clear();
+	EXPECT_FALSE(scene.changesSince(v0, changes));
+	EXPECT_TRUE(scene.changesSince(v0 + 1, changes));
+	EXPECT_EQ(changes.size(), 1u);
+
+	// The log is capped, the latest changes stay covered
+	for (size_t i = 0; i < 3 * Scene2D::MaxChangeLog; i++)
+		scene.markChanged(layer, 0);
+	EXPECT_LE(scene.changeLog.size(), Scene2D::MaxChangeLog);
+	changes.clear();
+	EXPECT_FALSE(scene.changesSince(v0 + 1, changes));
+	EXPECT_TRUE(scene.changesSince(scene.version - Scene2D::MaxChangeLog / 4, changes));
+	EXPECT_EQ(changes.size(), Scene2D::MaxChangeLog / 4);
+
+	// Copies and assigned scenes are different scenes
+	Scene2D copy = scene;
+	EXPECT_NE(copy.generation.id(), scene.generation.id());
+	const uint64_t generation = copy.generation.id();
+	copy = builder.build();
+	EXPECT_NE(copy.generation.id(), generation);
+}
+
+TEST(DR4Test, TestSceneJsonRoundTrip) {
+
+	using namespace dr4;
+	Scene2DBuilder builder;
+	size_t layer = builder.addLayer();
+	size_t material = builder.addMaterial(Material2D::CreateDefault());
+	builder.add(layer, ColorFill::CreateDefault());
+	Line2DCollection lines;
+	lines.material = material;
+	lines.append({ {0.f, 0.f}, {1.f, 1.f} });
+	lines.append({ {1.f, 0.f}, {0.f, 1.f} });
+	builder.add(layer, lines);
+	Scene2D scene = builder.build();
+	scene.layers[layer].blend.opacity = 0.25f;
+
+	JsonParser parser;
+	std::string str = parser.toJson(scene).toString();
+	JsonResult json = CreateJsonFromString(str);
+	ASSERT_TRUE(json);
+
+	Scene2D read;
+	ASSERT_TRUE(parser.fromJson(json.value(), read));
+	ASSERT_EQ(read.layers.size(), 1u);
+	EXPECT_EQ(read.layers[0].graphics.size(), 2u);
+	EXPECT_FLOAT_EQ(read.layers[0].blend.opacity.value(), 0.25f);
+	ASSERT_EQ(read.lines.size(), 1u);
+	EXPECT_EQ(read.lines[0].lines.size(), 2u);
+	EXPECT_EQ(read.materials.size(), scene.materials.size());
+
+	JsonResult invalid = CreateJsonFromString("{\"layers\":");
+	EXPECT_FALSE(invalid);
+	EXPECT_EQ(invalid.metaToString(), "ParseError");
+}
+
+TEST(DR4Test, TestSceneIndexQuery) {
+
+	using namespace dr4;
+	Scene2DBuilder builder;
+	size_t layer = builder.addLayer();
+	builder.add(layer, ColorFill::CreateDefault());
+	RandIntGenerator random;
+	auto coord = [&random]() { return 100.f * ((float)(random.next() & 0xffff) / 65535.f - 0.5f); };
+	Line2DCollection lines;
+	lines.material = 0;
+	for (int i = 0; i < 5000; i++) {
+		float x = coord(), y = coord();
+		lines.append({ {x, y}, {x + 0.01f * coord(), y + 0.01f * coord()} });
+	}
+	builder.add(layer, lines);
+	// Diagonal across the whole scene, too large for the grid cells
+	Line2DCollection diagonal;
+	diagonal.material = 0;
+	diagonal.append({ {-50.f, -50.f}, {50.f, 50.f} });
+	builder.add(layer, diagonal);
+	Scene2D scene = builder.build();
+	auto index = Scene2DIndex::Build(scene);
+	EXPECT_TRUE(index->isCurrent(scene));
+
+	// Query result must contain every line overlapping the span, sorted and without duplicates
+	Span2f span = Span2f::Create({ -3.f, -2.f }, { 4.f, 1.f });
+	std::vector<uint32_t> found;
+	index->query(span, found);
+	EXPECT_TRUE(std::is_sorted(found.begin(), found.end()));
+	EXPECT_TRUE(std::adjacent_find(found.begin(), found.end()) == found.end());
+	ASSERT_FALSE(found.empty());
+	EXPECT_EQ(index->items()[found[0]].element, 0u); // fill
+
+	size_t overlapping = 0;
+	for (uint32_t i = 0; i < (uint32_t)lines.lines.size(); i++) {
+		Span2f bounds = Span2f::Create(lines.lines[i].fst, lines.lines[i].snd);
+		if (bounds.x.max < span.x.min || bounds.x.min > span.x.max || bounds.y.max < span.y.min || bounds.y.min > span.y.max)
+			continue;
+		overlapping++;
+		EXPECT_TRUE(std::any_of(found.begin(), found.end(), [&](uint32_t f) {
+			return index->items()[f].element == 1 && index->items()[f].item == i; }));
+	}
+	EXPECT_GT(overlapping, 0u);
+	EXPECT_LT(found.size(), lines.lines.size() / 10);
+	EXPECT_TRUE(std::any_of(found.begin(), found.end(), [&](uint32_t f) { return index->items()[f].element == 2; }));
+
+	// Copies are other scenes, edits must be registered
+	Scene2D copy = scene;
+	EXPECT_FALSE(index->isCurrent(copy));
+	scene.markChanged(layer, 1);
+	EXPECT_FALSE(index->isCurrent(scene));
+}
+
+class CountTask : public dr4::ITask {
+public:
+	std::atomic<size_t>* counter = nullptr;
+	dr4::ThreadPool* pool = nullptr; // run a nested parallelFor when set
+	virtual void doTask() override {
+		if (pool)
+			pool->parallelFor(10, [this](size_t) { (*counter)++; });
+		else
+			(*counter)++;
+	}
+};
+
+TEST(DR4Test, TestThreadPoolRunsAllTasks) {
+
+	using namespace dr4;
+	ThreadPoolConfig config;
+	config.workers = 4;
+	config.pinThreads = true;
+	ThreadPool pool(config);
+	EXPECT_EQ(pool.workerCount(), 4u);
+
+	std::atomic<size_t> counter = 0;
+	ITask::Collection tasks;
+	for (size_t i = 0; i < 1000; i++) {
+		auto task = std::make_shared<CountTask>();
+		task->counter = &counter;
+		task->pool = i % 10 == 0 ? &pool : nullptr;
+		tasks.push_back(task);
+	}
+	ParallelExecutor executor(pool);
+	executor.runBlock(tasks);
+	EXPECT_EQ(counter, 900u + 100u * 10u);
+	EXPECT_TRUE(std::all_of(tasks.begin(), tasks.end(), [](const auto& t) { return t->isDone(); }));
+
+	// Blocks from several threads at once
+	counter = 0;
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < 4; t++)
+		threads.emplace_back([&pool, &counter]() { pool.parallelFor(500, [&counter](size_t) { counter++; }); });
+	for (auto& t : threads)
+		t.join();
+	EXPECT_EQ(counter, 2000u);
+}
+
+// Records the order in which tasks finish
+class OrderTask : public dr4::ITask {
+public:
+	std::atomic<size_t>* clock = nullptr;
+	size_t finished = 0;
+	virtual void doTask() override { finished = ++(*clock); }
+};
+
+TEST(DR4Test, TestTaskDependencies) {
+
+	using namespace dr4;
+	ThreadPoolConfig config;
+	config.workers = 3;
+	ThreadPool pool(config);
+	ParallelExecutor parallel(pool);
+	SequentialExecutor sequential;
+
+	for (int run = 0; run < 2; run++) {
+		// Layers of 20 tasks, each task depends on two tasks of the previous layer. Successors come first in the
+		// collection so that collection order alone would be wrong.
+		std::atomic<size_t> clock = 0;
+		std::vector<std::shared_ptr<OrderTask>> layers[4];
+		ITask::Collection tasks;
+		for (int l = 3; l >= 0; l--) {
+			for (size_t i = 0; i < 20; i++) {
+				auto task = std::make_shared<OrderTask>();
+				task->clock = &clock;
+				layers[l].push_back(task);
+				tasks.push_back(task);
+			}
+		}
+		for (int l = 1; l < 4; l++) {
+			for (size_t i = 0; i < 20; i++) {
+				layers[l][i]->addPredecessor(*layers[l - 1][i]);
+				layers[l][i]->addPredecessor(*layers[l - 1][(i + 7) % 20]);
+			}
+		}
+		// Root preceding the first layer, with more successors than are stored in the task
+		auto root = std::make_shared<OrderTask>();
+		root->clock = &clock;
+		for (size_t i = 0; i < 20; i++)
+			layers[0][i]->addPredecessor(*root);
+		tasks.push_back(root);
+		ASSERT_EQ(root->successorCount(), 20u);
+		for (size_t i = 0; i < 20; i++)
+			EXPECT_EQ(root->successor(i), layers[0][i].get());
+		if (run == 0)
+			parallel.runBlock(tasks);
+		else
+			sequential.runBlock(tasks);
+
+		EXPECT_EQ(clock, 81u);
+		for (size_t i = 0; i < 20; i++)
+			EXPECT_GT(layers[0][i]->finished, root->finished);
+		for (int l = 1; l < 4; l++) {
+			for (size_t i = 0; i < 20; i++) {
+				EXPECT_EQ(layers[l][i]->predecessorCount(), 2u);
+				EXPECT_GT(layers[l][i]->finished, layers[l - 1][i]->finished);
+				EXPECT_GT(layers[l][i]->finished, layers[l - 1][(i + 7) % 20]->finished);
+			}
+		}
+	}
+}
+
+TEST(DR4Test, TestTaskFuture) {
+
+	using namespace dr4;
+	ThreadPoolConfig config;
+	config.workers = 2;
+	ThreadPool pool(config);
+	ParallelExecutor executor(pool);
+
+	auto countTasks = [](std::atomic<size_t>& counter, size_t count) {
+		ITask::Collection tasks;
+		for (size_t i = 0; i < count; i++) {
+			auto task = std::make_shared<CountTask>();
+			task->counter = &counter;
+			tasks.push_back(task);
+		}
+		return tasks;
+	};
+
+	std::atomic<size_t> counter = 0;
+	std::atomic<size_t> continued = 0;
+	TaskFuture future = executor.submit(countTasks(counter, 200));
+	EXPECT_TRUE(future.valid());
+	future.then([&]() { continued += counter; });
+	future.wait();
+	EXPECT_TRUE(future.isReady());
+	EXPECT_EQ(counter, 200u);
+	EXPECT_EQ(continued, 200u);
+	// Attached after completion, called at once
+	future.then([&]() { continued++; });
+	EXPECT_EQ(continued, 201u);
+
+	// Dropped futures still run their tasks and continuations
+	std::atomic<size_t> dropped = 0;
+	std::atomic<bool> droppedDone = false;
+	executor.submit(countTasks(dropped, 50)).then([&]() { droppedDone = true; });
+	TaskFuture empty = executor.submit({});
+	empty.wait();
+	EXPECT_TRUE(empty.isReady());
+	while (!droppedDone)
+		std::this_thread::yield();
+	EXPECT_EQ(dropped, 50u);
+
+	SequentialExecutor sequential;
+	std::atomic<size_t> sequentialCounter = 0;
+	TaskFuture sequentialFuture = sequential.submit(countTasks(sequentialCounter, 10));
+	EXPECT_TRUE(sequentialFuture.isReady());
+	EXPECT_EQ(sequentialCounter, 10u);
+	EXPECT_FALSE(TaskFuture().isReady());
+}
+
+TEST(DR4Test, TestTaskArena) {
+
+	using namespace dr4;
+	std::atomic<size_t> counter = 0;
+	std::shared_ptr<CountTask> survivor;
+	{
+		TaskArena arena(4096);
+		SequentialExecutor executor;
+		size_t firstFrameBlocks = 0;
+		for (int frame = 0; frame < 4; frame++) {
+			arena.reset();
+			ITask::Collection tasks;
+			for (size_t i = 0; i < 200; i++) {
+				auto task = arena.create<CountTask>();
+				task->counter = &counter;
+				tasks.push_back(std::move(task));
+			}
+			executor.runBlock(tasks);
+			if (frame == 0)
+				firstFrameBlocks = arena.heapAllocations();
+		}
+		EXPECT_EQ(counter, 800u);
+		// Memory of the first frame is reused by the following ones
+		const size_t blocks = arena.heapAllocations();
+		EXPECT_GT(blocks, 1u);
+		EXPECT_EQ(blocks, firstFrameBlocks);
+
+		// A live task keeps its memory, the next frame gets new memory
+		survivor = arena.create<CountTask>();
+		survivor->counter = &counter;
+		arena.reset();
+		auto task = arena.create<CountTask>();
+		EXPECT_EQ(arena.heapAllocations(), blocks + 1);
+		EXPECT_NE((void*)task.get(), (void*)survivor.get());
+	}
+	// The task outlives the arena
+	survivor->doTask();
+	EXPECT_EQ(counter, 801u);
+	survivor.reset();
+}
+
+TEST(DR4Test, TestParallelFor2D) {
+
+	using namespace dr4;
+	ThreadPoolConfig config;
+	config.workers = 3;
+	ThreadPool pool(config);
+
+	// Every element is visited by exactly one call, ranges respect the grain
+	auto visitCounts = [&](size_t w, size_t h, ParallelGrain grain, size_t& calls) {
+		Array2D<int> visits(w, h, 0);
+		std::atomic<size_t> callCount = 0;
+		parallelFor2D(pool, w, h, grain, [&](const ParallelRange2D& r) {
+			callCount++;
+			EXPECT_LT(r.x0, r.x1);
+			EXPECT_LT(r.y0, r.y1);
+			if (grain.blockWidth == 0)
+				EXPECT_EQ(r.width(), w);
+			else
+				EXPECT_LE(r.width(), grain.blockWidth);
+			for (size_t y = r.y0; y < r.y1; y++)
+				for (size_t x = r.x0; x < r.x1; x++)
+					visits.at(x, y)++;
+		});
+		calls = callCount;
+		return std::count(visits.begin(), visits.end(), 1) == (ptrdiff_t)(w * h);
+	};
+
+	size_t calls = 0;
+	EXPECT_TRUE(visitCounts(1000, 777, ParallelGrain::Rows(1000), calls));
+	EXPECT_GT(calls, 1u);
+	EXPECT_LE(calls, 32u);
+	EXPECT_TRUE(visitCounts(1000, 777, ParallelGrain::Blocks(64, 4096), calls));
+	EXPECT_GT(calls, 16u);
+	EXPECT_TRUE(visitCounts(13, 3001, ParallelGrain::Blocks(64, 100), calls));
+	EXPECT_GT(calls, 1u);
+
+	// Small arrays are processed in a single call on the calling thread
+	EXPECT_TRUE(visitCounts(64, 64, ParallelGrain::Rows(), calls));
+	EXPECT_EQ(calls, 1u);
+	EXPECT_TRUE(visitCounts(1, 1, ParallelGrain::Blocks(0, 0), calls));
+	EXPECT_EQ(calls, 1u);
+	parallelFor2D(pool, 0, 10, ParallelGrain(), [&](const ParallelRange2D&) { calls++; });
+	EXPECT_EQ(calls, 1u);
+
+	// Fill goes through the global pool
+	Array2D<float> large(1031, 517, 0.f);
+	large.fill(2.f);
+	EXPECT_EQ(std::count(large.begin(), large.end(), 2.f), (ptrdiff_t)large.elementCount());
+}
+
+TEST(DR4Test, TestHalfFloatConversion) {
+
+	using namespace dr4;
+	EXPECT_EQ(FloatToHalf(0.f), 0x0000);
+	EXPECT_EQ(FloatToHalf(1.f), 0x3c00);
+	EXPECT_EQ(FloatToHalf(-2.f), 0xc000);
+	EXPECT_EQ(FloatToHalf(0.5f), 0x3800);
+	EXPECT_EQ(FloatToHalf(65504.f), 0x7bff);
+	EXPECT_EQ(FloatToHalf(1e6f), 0x7c00);
+	EXPECT_FLOAT_EQ(HalfToFloat(0x3c00), 1.f);
+	EXPECT_FLOAT_EQ(HalfToFloat(0x0001), 5.9604645e-8f);
+
+	// every finite half survives the round trip
+	for (uint32_t h = 0; h < 0x7c00; h++) {
+		EXPECT_EQ(FloatToHalf(HalfToFloat((uint16_t)h)), h);
+		EXPECT_EQ(FloatToHalf(-HalfToFloat((uint16_t)h)), h | 0x8000);
+	}
+}
+
+TEST(DR4Test, TestCompactFormatBlend) {
+
+	using namespace dr4;
+	RGBAFloat32 color = { 0.25f, 0.5f, 1.f, 0.5f };
+	const float coverage[3] = { 0.f, 1.f, 0.5f };
+
+	// blending over transparent black stores premultiplied color scaled by coverage
+	RGBAHalf16 half[3] = {};
+	PixelFormat<RGBAHalf16>::BlendSpan(half, coverage, 3, PixelFormat<RGBAHalf16>::Encode(color));
+	EXPECT_EQ(half[0].a, 0);
+	EXPECT_FLOAT_EQ(HalfToFloat(half[1].r), 0.125f);
+	EXPECT_FLOAT_EQ(HalfToFloat(half[1].a), 0.5f);
+	EXPECT_FLOAT_EQ(HalfToFloat(half[2].b), 0.25f);
+	EXPECT_FLOAT_EQ(HalfToFloat(half[2].a), 0.25f);
+
+	// opaque source at full coverage replaces the destination
+	SRGBA8Premultiplied bytes[2] = { {10, 20, 30, 255}, {10, 20, 30, 255} };
+	const float full[2] = { 1.f, 1.f };
+	PixelFormat<SRGBA8Premultiplied>::BlendSpan(bytes, full, 2, PixelFormat<SRGBA8Premultiplied>::Encode(RGBAFloat32::White()));
+	EXPECT_EQ(bytes[1].r, 255);
+	EXPECT_EQ(bytes[1].a, 255);
+}
+
+TEST(DR4Test, TestSRGBRowConversionMatchesScalar) {
+
+	using namespace dr4;
+	// Sweep float bit patterns over [0, 1.5] plus negative values, in rows whose length is not a multiple of the vector width
+	std::vector<RGBAFloat32> linear;
+	const uint32_t last = 0x3fc00000;
+	for (uint32_t bits = 0; bits < last; bits += 4 * 1237) {
+		float v[4];
+		for (uint32_t k = 0; k < 4; k++) {
+			uint32_t b = bits + k * 1237;
+			std::memcpy(&v[k], &b, sizeof(float));
+		}
+		linear.push_back({ v[0], -v[1], v[2], v[3] });
+	}
+	linear.push_back({ 1.f, 0.5f, 1e-9f, -1.f });
+	linear.push_back({ 3.f, 0.99999f, 0.0031308f, 2.f });
+
+	for (size_t count : { linear.size(), linear.size() - 3, (size_t)7 }) {
+		std::vector<SRGBA> srgb(count);
+		LinearToSRGBRow(linear.data(), srgb.data(), count);
+		size_t mismatches = 0;
+		for (size_t i = 0; i < count; i++) {
+			SRGBA ref = ToSRGBA(linear[i]);
+			if (ref.r != srgb[i].r || ref.g != srgb[i].g || ref.b != srgb[i].b || ref.a != srgb[i].a)
+				mismatches++;
+		}
+		EXPECT_EQ(mismatches, 0u) << count;
+	}
+
+	// Every 8 bit value in every channel
+	std::vector<SRGBA> bytes;
+	for (uint32_t v = 0; v < 256; v++)
+		bytes.push_back({ (uint8_t)v, (uint8_t)(255 - v), (uint8_t)(v * 7), (uint8_t)(v * 13) });
+	std::vector<RGBAFloat32> back(bytes.size());
+	SRGBToLinearRow(bytes.data(), back.data(), bytes.size());
+	for (size_t i = 0; i < bytes.size(); i++) {
+		RGBAFloat32 ref = ToRGBAFloat(bytes[i]);
+		EXPECT_EQ(ref.r, back[i].r);
+		EXPECT_EQ(ref.g, back[i].g);
+		EXPECT_EQ(ref.b, back[i].b);
+		EXPECT_EQ(ref.a, back[i].a);
+	}
+
+	// Images large enough to be split in bands
+	ImageRGBA32Linear image(1023, 301);
+	for (size_t i = 0; i < image.elementCount(); i++)
+		image.at(i) = linear[i % linear.size()];
+	auto converted = convertRBGA32LinearToSrgb(image);
+	auto roundTrip = convertToLinear(converted);
+	size_t mismatches = 0;
+	for (size_t i = 0; i < image.elementCount(); i++) {
+		SRGBA ref = ToSRGBA(image.at(i));
+		SRGBA c = converted.at(i);
+		RGBAFloat32 l = ToRGBAFloat(c);
+		RGBAFloat32 r = roundTrip.at(i);
+		if (ref.r != c.r || ref.g != c.g || ref.b != c.b || ref.a != c.a || l.r != r.r || l.g != r.g || l.b != r.b || l.a != r.a)
+			mismatches++;
+	}
+	EXPECT_EQ(mismatches, 0u);
+}
+
+TEST(DR4Test, TestPlanarImageMatchesInterleaved) {
+
+	using namespace dr4;
+	// width is not a multiple of the vector width, rows are padded
+	const size_t w = 37;
+	const size_t h = 5;
+	ImageRGBA32Linear a(w, h);
+	ImageRGBA32Linear b(w, h);
+	ImageFloat32Planar coverage(w, h);
+	EXPECT_EQ(coverage.stride() % 8, 0u);
+	for (size_t y = 0; y < h; y++) {
+		for (size_t x = 0; x < w; x++) {
+			float fx = (float)x / w;
+			float fy = (float)y / h;
+			a.at(x, y) = { fx, fy, 0.3f, 0.1f + 0.9f * fx * fy };
+			b.at(x, y) = { fy, 0.7f, fx, 0.2f + 0.8f * fy };
+			coverage.at(0, x, y) = fx;
+		}
+	}
+
+	auto pa = convertToPlanar(a);
+	auto pb = convertToPlanar(b);
+	auto back = convertToInterleaved(pa);
+	for (size_t i = 0; i < a.elementCount(); i++) {
+		EXPECT_EQ(back.at(i).r, a.at(i).r);
+		EXPECT_EQ(back.at(i).a, a.at(i).a);
+	}
+
+	auto expectEqual = [&](const ImageRGBA32LinearPlanar& planar, auto reference) {
+		auto result = convertToInterleaved(planar);
+		size_t mismatches = 0;
+		for (size_t y = 0; y < h; y++) {
+			for (size_t x = 0; x < w; x++) {
+				RGBAFloat32 ref = reference(x, y);
+				RGBAFloat32 res = result.at(x, y);
+				if (ref.r != res.r || ref.g != res.g || ref.b != res.b || ref.a != res.a)
+					mismatches++;
+			}
+		}
+		EXPECT_EQ(mismatches, 0u);
+	};
+
+	ImageRGBA32LinearPlanar blended = pb;
+	BlendAlpha(pa, blended);
+	expectEqual(blended, [&](size_t x, size_t y) { return BlendAlpha(a.at(x, y), b.at(x, y)); });
+
+	const RGBAFloat32 color = { 1.f, 0.5f, 0.25f, 0.75f };
+	ImageRGBA32LinearPlanar covered = pb;
+	BlendAlpha(color, coverage, covered);
+	expectEqual(covered, [&](size_t x, size_t y) {
+		RGBAFloat32 c = color;
+		c.a *= coverage.at(0, x, y);
+		return BlendAlpha(c, b.at(x, y));
+	});
+
+	ImageRGBA32LinearPlanar lerped(w, h);
+	Lerp(pa, pb, 0.3f, lerped);
+	expectEqual(lerped, [&](size_t x, size_t y) { return Lerp(a.at(x, y), b.at(x, y), 0.3f); });
+	Lerp(pa, pb, coverage, lerped);
+	expectEqual(lerped, [&](size_t x, size_t y) { return Lerp(a.at(x, y), b.at(x, y), coverage.at(0, x, y)); });
+
+	Fill(lerped, color);
+	expectEqual(lerped, [&](size_t, size_t) { return color; });
+}
+
+TEST(DR4Test, TestGradientFill) {
+
+	using namespace dr4;
+	const size_t w = 37;
+	const size_t h = 11;
+	const RGBAFloat32 background = { 0.f, 0.f, 1.f, 1.f };
+	auto lut = LookUpTable<RGBAFloat32>::Create({ { 0.f, 0.f, 0.f, 1.f }, { 1.f, 1.f, 1.f, 1.f } }, 0.f, 1.f);
+	auto redAt = [&](const ImageRGBA32Linear& img, size_t x, size_t y) { return img.at(x, h - y - 1).r; };
+
+	// Linear from x = 0 to x = 32, clipped to x in [2, 34), y in [1, 10)
+	ImageRGBA32Linear img(w, h, background);
+	FillGradient(img, GradientGeometry::Linear({ 0.f, 0.f }, { 32.f, 0.f }), lut, RasterDomain::Create({ 2, 1 }, 32, 9));
+	for (size_t x = 2; x < 34; x++)
+		EXPECT_NEAR(redAt(img, x, 5), std::min(1.f, (x + 0.5f) / 32.f), 1e-5f) << x;
+	EXPECT_EQ(img.at(1, h - 5 - 1).b, 1.f);
+	EXPECT_EQ(img.at(34, h - 5 - 1).b, 1.f);
+	EXPECT_EQ(img.at(10, h - 0 - 1).b, 1.f);
+	EXPECT_EQ(img.at(10, h - 10 - 1).b, 1.f);
+	EXPECT_FLOAT_EQ(img.at(10, h - 5 - 1).b, redAt(img, 10, 5));
+
+	// Radial gradient is symmetric around its center
+	ImageRGBA32Linear radial(w, h, background);
+	FillGradient(radial, GradientGeometry::Radial({ 18.5f, 5.5f }, 10.f), lut, RasterDomain::Create(w, h));
+	EXPECT_FLOAT_EQ(redAt(radial, 18, 5), 0.f);
+	EXPECT_NEAR(redAt(radial, 23, 5), 0.5f, 1e-5f);
+	EXPECT_FLOAT_EQ(redAt(radial, 23, 5), redAt(radial, 13, 5));
+	EXPECT_FLOAT_EQ(redAt(radial, 36, 5), 1.f);
+
+	// Conic gradient measures turns counterclockwise from the start direction
+	ImageRGBA32Linear conic(w, h, background);
+	FillGradient(conic, GradientGeometry::Conic({ 18.5f, 5.5f }, 0.f), lut, RasterDomain::Create(w, h));
+	EXPECT_NEAR(redAt(conic, 18, 9), 0.25f, 1e-4f);
+	EXPECT_NEAR(redAt(conic, 10, 5), 0.5f, 1e-4f);
+	EXPECT_NEAR(redAt(conic, 18, 1), 0.75f, 1e-4f);
+	EXPECT_NEAR(redAt(conic, 22, 9), (float)(atan2(4., 4.) / (2. * 3.14159265358979)), 1e-4f);
+}
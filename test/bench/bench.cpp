@@ -0,0 +1,373 @@
+// Rasterizer benchmarks. Results are printed and written as JSON for comparison between builds.
+//
+// Usage: bench [--out results.json] [--quick]
+
+#include <dr4/dr4_cpu.h>
+#include <dr4/dr4_rand.h>
+#include <dr4/dr4_image.h>
+#include <dr4/dr4_scene2d.h>
+#include <dr4/dr4_rasterizer.h>
+#include <dr4/dr4_rasterizer_algorithms.h>
+#include <dr4/dr4_task.h>
+#include <dr4/dr4_threadpool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Heap allocations of the process, counted to show the allocations made per frame
+static atomic<size_t> g_allocations = 0;
+
+void* operator new(size_t size) {
+	g_allocations++;
+	if (void* p = malloc(size ? size : 1))
+		return p;
+	throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+namespace {
+
+	struct BenchResult {
+		string name;
+		string params; // JSON object members, e.g. "\"width\":640"
+		string unit;
+		double value; // items per second in unit, or the recorded value
+		double seconds; // best time of a repetition
+		size_t repetitions;
+	};
+
+	struct BenchContext {
+		bool quick = false;
+		vector<BenchResult> results;
+
+		size_t repetitions() const { return quick ? 3 : 10; }
+
+		// Run fun repeatedly and record the best time. fun returns the number of items processed,
+		// scale converts items per second to unit.
+		void run(const string& name, const string& params, const string& unit, double scale, const function<size_t()>& fun) {
+			fun(); // warm up caches and lazily initialized tables
+			double best = 1e30;
+			size_t items = 0;
+			for (size_t i = 0; i < repetitions(); i++) {
+				auto start = chrono::steady_clock::now();
+				items = fun();
+				double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+				best = std::min(best, seconds);
+			}
+			BenchResult result = { name, params, unit, scale * (double)items / best, best, repetitions() };
+			cout << name << " " << params << " " << result.value << " " << unit << " (" << 1e3 * best << " ms)" << endl;
+			results.push_back(result);
+		}
+
+		// Record a measured quantity, e.g. a count per frame
+		void record(const string& name, const string& params, const string& unit, double value) {
+			cout << name << " " << params << " " << value << " " << unit << endl;
+			results.push_back({ name, params, unit, value, 0.0, 1 });
+		}
+
+		string json() const {
+			ostringstream out;
+			out << "{\n\"hardwareConcurrency\":" << std::thread::hardware_concurrency() << ",\n\"results\":[";
+			for (size_t i = 0; i < results.size(); i++) {
+				const auto& r = results[i];
+				out << (i ? "," : "") << "\n{\"name\":\"" << r.name << "\",\"params\":{" << r.params << "},\"unit\":\""
+					<< r.unit << "\",\"value\":" << r.value << ",\"seconds\":" << r.seconds
+					<< ",\"repetitions\":" << r.repetitions << "}";
+			}
+			out << "\n]}\n";
+			return out.str();
+		}
+	};
+
+	// Random coordinates in [0, size)
+	struct RandomPoints {
+		dr4::RandIntGenerator random;
+		float size;
+		RandomPoints(float s) :size(s) {}
+		float next() { return size * (float)(random.next() & 0xffff) / 65536.f; }
+		dr4::Pairf point() { float x = next(); return { x, next() }; }
+	};
+
+	void BenchLines(BenchContext& ctx) {
+		using namespace dr4;
+		const size_t size = 1024;
+		const size_t count = ctx.quick ? 20000 : 100000;
+		RandomPoints random((float)size);
+		vector<Pairf> points(2 * count);
+		for (auto& p : points)
+			p = random.point();
+		ImageRGBA32Linear image(size, size);
+		Painter painter(image);
+		const string params = "\"width\":1024,\"height\":1024";
+
+		ctx.run("DrawLine", params, "lines/s", 1.0, [&]() {
+			for (size_t i = 0; i < count; i++)
+				Razz::DrawLine(painter, RGBAFloat32::Black(), points[2 * i], points[2 * i + 1]);
+			return count;
+		});
+		ctx.run("DrawLineFixed", params, "lines/s", 1.0, [&]() {
+			for (size_t i = 0; i < count; i++)
+				Razz::DrawLineFixed(painter, RGBAFloat32::Black(), points[2 * i], points[2 * i + 1]);
+			return count;
+		});
+		ctx.run("DrawStroke", params + ",\"lineWidth\":3", "lines/s", 1.0, [&]() {
+			const size_t strokes = count / 10;
+			for (size_t i = 0; i < strokes; i++)
+				Razz::DrawStroke(painter, RGBAFloat32::Black(), points[2 * i], points[2 * i + 1], 3.f);
+			return strokes;
+		});
+	}
+
+	// Triangles with vertices on integer coordinates, so that the kernels truncating vertices to int draw the
+	// same triangles as the others, wound so that edge functions are positive inside, which is the only winding
+	// DrawTriangle2 and DrawTriangle3 fill.
+	vector<dr4::Pairf> RandomTriangles(size_t count, size_t size, float edge) {
+		using namespace dr4;
+		RandomPoints random((float)size - edge);
+		RandomPoints offset(edge);
+		vector<Pairf> points(3 * count);
+		for (size_t i = 0; i < count; i++) {
+			Pairf base = random.point();
+			Pairf* t = &points[3 * i];
+			for (size_t k = 0; k < 3; k++) {
+				Pairf o = offset.point();
+				t[k] = { std::floor(base.x + o.x), std::floor(base.y + o.y) };
+			}
+			float area = (t[1].x - t[0].x) * (t[2].y - t[0].y) - (t[1].y - t[0].y) * (t[2].x - t[0].x);
+			if (area < 0.f)
+				std::swap(t[1], t[2]);
+		}
+		return points;
+	}
+
+	void BenchTriangles(BenchContext& ctx) {
+		using namespace dr4;
+		const size_t size = 1024;
+		ImageRGBA32Linear image(size, size);
+		Painter painter(image);
+
+		typedef void (*TriangleFun)(Painter&, const RGBAFloat32&, float, float, float, float, float, float);
+		const pair<const char*, TriangleFun> kernels[] = {
+			{ "DrawTriangle", &Razz::DrawTriangle },
+			{ "DrawTriangle2", &Razz::DrawTriangle2 },
+			{ "DrawTriangle3", &Razz::DrawTriangle3 } };
+
+		for (size_t edge : { 8, 32, 128, 512 }) {
+			// Fewer large triangles, so that each size covers about as many pixels as edge 32
+			const size_t baseCount = ctx.quick ? 20000 : 100000;
+			const size_t count = edge <= 32 ? baseCount : baseCount * 32 * 32 / (edge * edge);
+			const vector<Pairf> points = RandomTriangles(count, size, (float)edge);
+			const string params = "\"width\":1024,\"height\":1024,\"edge\":" + to_string(edge);
+
+			for (const auto& kernel : kernels) {
+				ctx.run(kernel.first, params, "triangles/s", 1.0, [&]() {
+					for (size_t i = 0; i < count; i++) {
+						const Pairf* t = &points[3 * i];
+						kernel.second(painter, RGBAFloat32::Red(), t[0].x, t[0].y, t[1].x, t[1].y, t[2].x, t[2].y);
+					}
+					return count;
+				});
+			}
+			ctx.run("DrawTriangleFixed", params, "triangles/s", 1.0, [&]() {
+				for (size_t i = 0; i < count; i++) {
+					const Pairf* t = &points[3 * i];
+					Razz::DrawTriangleFixed(painter, RGBAFloat32::Red(), t[0], t[1], t[2]);
+				}
+				return count;
+			});
+			// The two traversals DrawTriangleFixed chooses between by size, to place the threshold
+			typedef void (*TraversalFun)(Painter&, const RGBAFloat32&, Pairf, Pairf, Pairf, int, int, SimdLevel);
+			const pair<const char*, TraversalFun> traversals[] = {
+				{ "DrawTriangleScanline", &Razz::DrawTriangleScanline<RGBAFloat32> },
+				{ "DrawTriangleHierarchical", &Razz::DrawTriangleHierarchical<RGBAFloat32> } };
+			for (const auto& traversal : traversals) {
+				ctx.run(traversal.first, params, "triangles/s", 1.0, [&]() {
+					for (size_t i = 0; i < count; i++) {
+						const Pairf* t = &points[3 * i];
+						traversal.second(painter, RGBAFloat32::Red(), t[0], t[1], t[2], 0, 0, SimdLevel::Scalar);
+					}
+					return count;
+				});
+			}
+			// The vector span finders, to check whether they have become worth dispatching to
+			for (SimdLevel level : { SimdLevel::SSE2, SimdLevel::AVX2 }) {
+				if (level > CpuFeatures::Get().bestSimdLevel())
+					continue;
+				const string simdParams = params + ",\"simd\":\"" + SimdLevelToString(level) + "\"";
+				ctx.run("DrawTriangleFixed", simdParams, "triangles/s", 1.0, [&]() {
+					for (size_t i = 0; i < count; i++) {
+						const Pairf* t = &points[3 * i];
+						Razz::DrawTriangleFixed(painter, RGBAFloat32::Red(), t[0], t[1], t[2], 0, 0, level);
+					}
+					return count;
+				});
+			}
+		}
+	}
+
+	void BenchGradients(BenchContext& ctx) {
+		using namespace dr4;
+		const size_t w = 1920;
+		const size_t h = 1080;
+		GradientFloat32 grad = { { {0.0f, RGBAFloat32::Red()}, {0.6f, RGBAFloat32::Yellow()}, {1.f, RGBAFloat32::Blue() }} };
+		auto lut = GradientToLUT(grad);
+		ImageRGBA32Linear image(w, h, RGBAFloat32::Navy());
+		Painter painter(image);
+
+		const pair<const char*, GradientGeometry> geometries[] = {
+			{ "FillGradientLinear", GradientGeometry::Linear({ 0.f, 0.f }, { (float)w, (float)h }) },
+			{ "FillGradientRadial", GradientGeometry::Radial({ 0.5f * w, 0.5f * h }, 0.5f * h) },
+			{ "FillGradientConic", GradientGeometry::Conic({ 0.5f * w, 0.5f * h }, 0.f) } };
+		for (const auto& geometry : geometries) {
+			ctx.run(geometry.first, "\"width\":1920,\"height\":1080", "MPix/s", 1e-6, [&]() {
+				painter.fillGradient(geometry.second, lut, RasterDomain::Create(w, h));
+				return w * h;
+			});
+		}
+	}
+
+	void BenchResolve(BenchContext& ctx) {
+		using namespace dr4;
+		const size_t w = 3840;
+		const size_t h = 2160;
+		ImageRGBA32Linear image(w, h);
+		RandomPoints random(1.f);
+		for (size_t i = 0; i < image.elementCount(); i++)
+			image.at(i) = { random.next(), random.next(), random.next(), 1.f };
+		ctx.run("LinearToSRGB", "\"width\":3840,\"height\":2160", "MPix/s", 1e-6, [&]() {
+			auto srgb = convertRBGA32LinearToSrgb(image);
+			return srgb.elementCount();
+		});
+	}
+
+	// Frame of a white fill and random lines, as in the scene tests. With more than one layer the lines are
+	// split over the layers, which are composited at half opacity.
+	dr4::Scene2D FrameScene(size_t lineCount, size_t layerCount = 1) {
+		using namespace dr4;
+		Scene2DBuilder builder;
+		Material2D material = Material2D::CreateDefault();
+		size_t materialIdx = builder.addMaterial(material);
+		RandomPoints random(1.2f);
+		for (size_t layer = 0; layer < layerCount; layer++) {
+			size_t layerIdx = builder.addLayer();
+			Line2DCollection lines;
+			lines.material = materialIdx;
+			for (size_t i = 0; i < lineCount / layerCount; i++) {
+				Pairf a = random.point(), b = random.point();
+				lines.append({ {a.x - 0.6f, a.y - 0.6f}, {b.x - 0.6f, b.y - 0.6f} });
+			}
+			if (layer == 0)
+				builder.add(layerIdx, ColorFill{ RGBAFloat32::White() });
+			builder.add(layerIdx, lines);
+		}
+		Scene2D scene = builder.build();
+		for (size_t layer = 1; layer < layerCount; layer++)
+			scene.layers[layer].blend.opacity = 0.5f;
+		return scene;
+	}
+
+	void BenchFrames(BenchContext& ctx) {
+		using namespace dr4;
+		const size_t lineCount = ctx.quick ? 2000 : 10000;
+		Scene2D scene = FrameScene(lineCount);
+		Scene2D layered = FrameScene(lineCount, 2);
+		const pair<unsigned, unsigned> resolutions[] = { {640, 480}, {1920, 1080}, {3840, 2160} };
+
+		vector<size_t> threadCounts = { 1 };
+		const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+		for (size_t t = 2; t < hardware; t *= 2)
+			threadCounts.push_back(t);
+		if (hardware > 1)
+			threadCounts.push_back(hardware);
+
+		for (const auto& resolution : resolutions) {
+			const unsigned w = resolution.first;
+			const unsigned h = resolution.second;
+			RasterDomain rasterDomain = RasterDomain::Create(w, h);
+			float aspect = rasterDomain.aspectRatio();
+			SceneDomain sceneDomain = { Span2f::Create({-0.5f * aspect, -0.5f}, {0.5f * aspect, 0.5f}) };
+			auto config = RasterConfig2D::Create(rasterDomain, sceneDomain);
+			auto rasterizer = CreateRasterizer(w, h, RasterizerConfig::Tiled(128, 128));
+
+			for (size_t threads : threadCounts) {
+				// Pool of a fixed size so that scaling can be measured, the calling thread is one of the threads
+				ThreadPoolConfig poolConfig;
+				poolConfig.workers = threads - 1;
+				ThreadPool pool(poolConfig);
+				ParallelExecutor executor(pool);
+				ostringstream params;
+				params << "\"width\":" << w << ",\"height\":" << h << ",\"threads\":" << threads << ",\"lines\":" << lineCount;
+				size_t taskCount = 0;
+				auto frame = [&](const Scene2D& frameScene) {
+					FrameTasks tasks;
+					rasterizer->draw2D(config, frameScene, tasks);
+					executor.runBlock(tasks.tasks);
+					rasterizer->applyResult(tasks);
+					taskCount = tasks.tasks.size();
+					return size_t(1);
+				};
+				ctx.run("Frame2D", params.str(), "frames/s", 1.0, [&]() { return frame(scene); });
+
+				// Layered frames have a composite task per tile, which depends on the draw tasks of the tile
+				for (const Scene2D* frameScene : { &scene, &layered }) {
+					frame(*frameScene);
+					const size_t allocationsBefore = g_allocations;
+					frame(*frameScene);
+					ctx.record("Frame2DAllocations", params.str() + ",\"layers\":" + to_string(frameScene->layers.size())
+						+ ",\"tasks\":" + to_string(taskCount), "allocations/frame", (double)(g_allocations - allocationsBefore));
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	BenchContext ctx;
+	string outPath = "bench-results.json";
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--quick")
+			ctx.quick = true;
+		else if (arg == "--out" && i + 1 < argc)
+			outPath = argv[++i];
+		else {
+			cerr << "Usage: bench [--out results.json] [--quick]" << endl;
+			return 1;
+		}
+	}
+
+	BenchLines(ctx);
+	BenchTriangles(ctx);
+	BenchGradients(ctx);
+	BenchResolve(ctx);
+	BenchFrames(ctx);
+
+	ofstream out(outPath, ios::binary | ios::out);
+	out << ctx.json();
+	if (!out) {
+		cerr << "Could not write " << outPath << endl;
+		return 1;
+	}
+	cout << "Results written to " << outPath << endl;
+	return 0;
+}
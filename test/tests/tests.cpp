@@ -19,6 +19,13 @@
 #include <dr4/dr4_analysis.h>
 #include <dr4/dr4_timer.h>
 #include <dr4/dr4_handlemanager.h>
+#include <dr4/dr4_framepipeline.h>
+#include <dr4/dr4_bandrender.h>
+#include <dr4/dr4_scene2d_index.h>
+#include <dr4/dr4_profile.h>
+#include <dr4/dr4_batchrender.h>
+#include <dr4/dr4_json_parser.h>
+#include <dr4/dr4_io.h>
 
 using namespace std;
 
@@ -187,6 +194,618 @@ TESTFUN(scene, scenetest01){
     writeImageAsPng(image, prefix("out.png"));
 }
 
+dr4::Scene2D GetTestSceneRandomLines(size_t lineCount, float lineWidth = 1.0f){
+    using namespace dr4;
+    Scene2DBuilder builder;
+
+    size_t layerIdx = builder.addLayer();
+    Material2D mat = Material2D::CreateDefault();
+    mat.linewidth = lineWidth;
+    size_t materialIdx = builder.addMaterial(mat);
+
+    // Coordinates in range [-0.6, 0.6]
+    RandIntGenerator random;
+    auto coord = [&random]() { return 1.2f * ((float)(random.next() & 0xffff) / 65535.f - 0.5f); };
+    Line2DCollection lines;
+    lines.material = materialIdx;
+    for (size_t i = 0; i < lineCount; i++) {
+        float x0 = coord(), y0 = coord(), x1 = coord(), y1 = coord();
+        lines.append({ {x0, y0}, {x1, y1} });
+    }
+
+    builder.add(layerIdx, ColorFill{ RGBAFloat32::White() });
+    builder.add(layerIdx, lines);
+    return builder.build();
+}
+
+// Scene area of unit height centered at origin
+dr4::RasterConfig2D GetTestRasterConfig(unsigned width, unsigned height) {
+    using namespace dr4;
+    RasterDomain rasterDomain = RasterDomain::Create(width, height);
+    float aspect = rasterDomain.aspectRatio();
+    SceneDomain sceneDomain = { Span2f::Create({-0.5f * aspect, -0.5f}, {0.5f * aspect, 0.5f}) };
+    return RasterConfig2D::Create(rasterDomain, sceneDomain);
+}
+
+// Render frame, return the number of tasks used
+size_t RenderFrame(dr4::IRasterizer& rasterizer, const dr4::RasterConfig2D& config, const dr4::Scene2D& scene) {
+    using namespace dr4;
+    FrameTasks tasks;
+    ParallelExecutor executor;
+    rasterizer.draw2D(config, scene, tasks);
+    executor.runBlock(tasks.tasks);
+    rasterizer.applyResult(tasks);
+    return tasks.tasks.size();
+}
+
+dr4::ImageRGBA8SRGB RenderScene(const dr4::Scene2D& scene, unsigned width, unsigned height, dr4::RasterizerConfig rasterizerConfig) {
+    using namespace dr4;
+    auto rasterizer = CreateRasterizer(width, height, rasterizerConfig);
+    RenderFrame(*rasterizer, GetTestRasterConfig(width, height), scene);
+    return rasterizer->getColorAsSRGB();
+}
+
+size_t CountDifferingPixels(const dr4::ImageRGBA8SRGB& a, const dr4::ImageRGBA8SRGB& b) {
+    size_t count = 0;
+    for (size_t i = 0; i < a.elementCount(); i++) {
+        auto pa = a.at(i);
+        auto pb = b.at(i);
+        if (pa.r != pb.r || pa.g != pb.g || pa.b != pb.b || pa.a != pb.a)
+            count++;
+    }
+    return count;
+}
+
+TESTFUN(scene, scenetiled01){
+    using namespace dr4;
+    const unsigned w = 640;
+    const unsigned h = 480;
+    Scene2D scene = GetTestSceneRandomLines(200);
+
+    auto reference = RenderScene(scene, w, h, RasterizerConfig::SingleTile());
+    auto tiled64 = RenderScene(scene, w, h, RasterizerConfig::Tiled(64, 64));
+    auto tiled100 = RenderScene(scene, w, h, RasterizerConfig::Tiled(100, 70));
+
+    size_t diff64 = CountDifferingPixels(reference, tiled64);
+    size_t diff100 = CountDifferingPixels(reference, tiled100);
+    if (diff64 != 0 || diff100 != 0)
+        cout << errorString("tiled output differs from single tile output") << " " << diff64 << " " << diff100 << endl;
+
+    writeImageAsPng(reference, prefix("single.png"));
+    writeImageAsPng(tiled64, prefix("tiled64.png"));
+}
+
+TESTFUN(scene, scenestrokes01){
+    using namespace dr4;
+    const unsigned w = 640;
+    const unsigned h = 480;
+    Scene2D scene = GetTestSceneRandomLines(60, 7.5f);
+
+    auto reference = RenderScene(scene, w, h, RasterizerConfig::SingleTile());
+    auto tiled = RenderScene(scene, w, h, RasterizerConfig::Tiled(64, 64));
+
+    // Stroke coverage is evaluated at pixel centers in full buffer coordinates, tiling must not change it
+    size_t diff = CountDifferingPixels(reference, tiled);
+    if (diff != 0)
+        cout << errorString("tiled output differs from single tile output") << " " << diff << endl;
+
+    writeImageAsPng(reference, prefix("single.png"));
+    writeImageAsPng(tiled, prefix("tiled64.png"));
+}
+
+dr4::Scene2D GetTestScenePolygons01(){
+    using namespace dr4;
+    Scene2DBuilder builder;
+
+    size_t layerIdx = builder.addLayer();
+    Material2D starMaterial = Material2D::CreateDefault();
+    starMaterial.colorFill = RGBAFloat32::Orange();
+    size_t starMaterialIdx = builder.addMaterial(starMaterial);
+    Material2D concaveMaterial = Material2D::CreateDefault();
+    concaveMaterial.colorFill = RGBAFloat32::Navy();
+    size_t concaveMaterialIdx = builder.addMaterial(concaveMaterial);
+
+    // Star with five points
+    Polygon2D star;
+    const float pi = 3.14159265f;
+    for (int i = 0; i < 10; i++) {
+        float r = (i % 2 == 0) ? 0.45f : 0.18f;
+        float angle = 0.5f * pi + i * pi / 5.f;
+        star.points.points.push_back({ r * cosf(angle), r * sinf(angle) });
+    }
+
+    // Concave 'C' shape, clockwise
+    Polygon2D concave = { {{{-0.6f, -0.45f}, {-0.6f, 0.45f}, {-0.3f, 0.45f}, {-0.3f, 0.3f},
+        {-0.45f, 0.3f}, {-0.45f, -0.3f}, {-0.3f, -0.3f}, {-0.3f, -0.45f}}} };
+
+    builder.add(layerIdx, ColorFill{ RGBAFloat32::White() });
+    builder.add(layerIdx, PolygonFill2D::Create(star, starMaterialIdx));
+    builder.add(layerIdx, PolygonFill2D::Create(concave, concaveMaterialIdx));
+    return builder.build();
+}
+
+TESTFUN(scene, scenepolygons01){
+    using namespace dr4;
+    const unsigned w = 640;
+    const unsigned h = 480;
+    Scene2D scene = GetTestScenePolygons01();
+
+    auto reference = RenderScene(scene, w, h, RasterizerConfig::SingleTile());
+    auto tiled = RenderScene(scene, w, h, RasterizerConfig::Tiled(64, 64));
+
+    // Triangles are snapped in full buffer coordinates, so tiling must not change coverage
+    size_t diff = CountDifferingPixels(reference, tiled);
+    if (diff != 0)
+        cout << errorString("tiled output differs from single tile output") << " " << diff << endl;
+
+    writeImageAsPng(reference, prefix("single.png"));
+    writeImageAsPng(tiled, prefix("tiled64.png"));
+}
+
+size_t MaxChannelDifference(const dr4::ImageRGBA8SRGB& a, const dr4::ImageRGBA8SRGB& b) {
+    size_t maxDiff = 0;
+    auto channelDiff = [](uint8_t x, uint8_t y) { return (size_t)(x > y ? x - y : y - x); };
+    for (size_t i = 0; i < a.elementCount(); i++) {
+        auto pa = a.at(i);
+        auto pb = b.at(i);
+        maxDiff = std::max(maxDiff, channelDiff(pa.r, pb.r));
+        maxDiff = std::max(maxDiff, channelDiff(pa.g, pb.g));
+        maxDiff = std::max(maxDiff, channelDiff(pa.b, pb.b));
+        maxDiff = std::max(maxDiff, channelDiff(pa.a, pb.a));
+    }
+    return maxDiff;
+}
+
+TESTFUN(scene, sceneformats01){
+    using namespace dr4;
+    const unsigned w = 640;
+    const unsigned h = 480;
+    Scene2D polygons = GetTestScenePolygons01();
+    Scene2D lines = GetTestSceneRandomLines(200);
+    Scene2D strokes = GetTestSceneRandomLines(60, 7.5f);
+    auto tiled = RasterizerConfig::Tiled(64, 64);
+
+    auto compare = [&](const char* name, const Scene2D& scene, size_t allowedDiff16F, size_t allowedDiff8) {
+        auto reference = RenderScene(scene, w, h, tiled);
+        for (auto format : { RenderFormat::RGBA16FPremultiplied, RenderFormat::RGBA8Premultiplied }) {
+            auto image = RenderScene(scene, w, h, tiled.withFormat(format));
+            size_t diff = MaxChannelDifference(reference, image);
+            size_t allowedDiff = format == RenderFormat::RGBA8Premultiplied ? allowedDiff8 : allowedDiff16F;
+            if (diff > allowedDiff)
+                cout << errorString("render format differs from RGBA32F") << " " << name << " "
+                    << RenderFormatToString(format) << " " << diff << endl;
+            writeImageAsPng(image, prefix(std::string(name) + "_" + RenderFormatToString(format) + ".png"));
+        }
+    };
+
+    // Opaque content is stored exactly in all formats. Anti-aliased stroke edges round differently in
+    // half floats and are blended in sRGB encoded space in RGBA8, which darkens partially covered pixels.
+    compare("polygons", polygons, 0, 0);
+    compare("lines", lines, 0, 0);
+    compare("strokes", strokes, 1, 96);
+}
+
+// Polygons with a layer of strokes at given opacity and a layer of polygons drawn over the strokes
+dr4::Scene2D GetTestSceneLayers01(float strokeOpacity, bool withStrokes = true){
+    using namespace dr4;
+    Scene2D scene = GetTestScenePolygons01();
+
+    Material2D strokeMaterial = Material2D::CreateDefault();
+    strokeMaterial.linewidth = 9.f;
+    strokeMaterial.colorLine = RGBAFloat32::Green();
+    scene.materials.push_back(strokeMaterial);
+    Line2DCollection lines;
+    lines.material = scene.materials.size() - 1;
+    for (int i = 0; i < 12; i++) {
+        float y = -0.45f + 0.08f * i;
+        lines.append({ {-0.65f, y}, {0.65f, y + 0.05f} });
+    }
+    scene.lines.push_back(lines);
+    Layer strokeLayer;
+    strokeLayer.blend = Blend::Default();
+    strokeLayer.blend.opacity = strokeOpacity;
+    if (withStrokes)
+        strokeLayer.graphics.push_back({ Content2D::Lines, scene.lines.size() - 1 });
+    scene.layers.push_back(strokeLayer);
+
+    Material2D topMaterial = Material2D::CreateDefault();
+    topMaterial.colorFill = RGBAFloat32::Red();
+    scene.materials.push_back(topMaterial);
+    Polygon2D square = { {{{0.1f, -0.1f}, {0.3f, -0.1f}, {0.3f, 0.1f}, {0.1f, 0.1f}}} };
+    Layer topLayer;
+    topLayer.blend = Blend::Default();
+    scene.polygons.push_back(PolygonFill2D::Create(square, scene.materials.size() - 1));
+    topLayer.graphics.push_back({ Content2D::Polygon, scene.polygons.size() - 1 });
+    scene.layers.push_back(topLayer);
+    return scene;
+}
+
+TESTFUN(scene, scenelayers01){
+    using namespace dr4;
+    const unsigned w = 640;
+    const unsigned h = 480;
+    auto tiled = RasterizerConfig::Tiled(64, 64);
+
+    for (auto format : { RenderFormat::RGBA32F, RenderFormat::RGBA16FPremultiplied, RenderFormat::RGBA8Premultiplied }) {
+        Scene2D scene = GetTestSceneLayers01(0.5f);
+        auto single = RenderScene(scene, w, h, RasterizerConfig::SingleTile().withFormat(format));
+        auto layered = RenderScene(scene, w, h, tiled.withFormat(format));
+
+        // Transparent and opaque layers match the scene without the layer and with a direct layer
+        auto transparent = RenderScene(GetTestSceneLayers01(0.f), w, h, tiled.withFormat(format));
+        auto withoutStrokes = RenderScene(GetTestSceneLayers01(1.f, false), w, h, tiled.withFormat(format));
+        auto opaque = RenderScene(GetTestSceneLayers01(1.f), w, h, tiled.withFormat(format));
+
+        size_t tiledDiff = CountDifferingPixels(single, layered);
+        size_t transparentDiff = CountDifferingPixels(transparent, withoutStrokes);
+        size_t blendedDiff = CountDifferingPixels(layered, opaque);
+        if (tiledDiff != 0 || transparentDiff != 0 || blendedDiff == 0)
+            cout << errorString("layer compositing failed") << " " << RenderFormatToString(format) << " "
+                << tiledDiff << " " << transparentDiff << " " << blendedDiff << endl;
+
+        // Composited values at a stroke center over the white background, at the background between strokes
+        // and at the opaque square of the top layer. RGBA8 blends sRGB encoded values, the float formats
+        // blend linear values.
+        auto blendHalf = [&](float linearSrc, float linearDst) {
+            if (format == RenderFormat::RGBA8Premultiplied)
+                return (uint8_t)((LinearFloatToSRGBUint8(linearSrc) + LinearFloatToSRGBUint8(linearDst)) / 2);
+            return LinearFloatToSRGBUint8(0.5f * (linearSrc + linearDst));
+        };
+        const SRGBA greenOverWhite = { blendHalf(0.f, 1.f), 255, blendHalf(0.f, 1.f), 255 };
+        const float strokeX = 0.55f; // right of the star, on the third stroke
+        const float strokeY = -0.29f + 0.05f * (strokeX + 0.65f) / 1.3f;
+        const std::pair<Pairf, SRGBA> expected[] = {
+            { { strokeX, strokeY }, greenOverWhite },
+            { { strokeX, strokeY + 0.04f }, { 255, 255, 255, 255 } },
+            { { 0.2f, 0.f }, { 255, 0, 0, 255 } } };
+        auto sceneToRaster = GetTestRasterConfig(w, h).sceneToRaster();
+        for (const auto& e : expected) {
+            // raster coordinates are y-up, the rows of the image are stored top down
+            Pairf p = sceneToRaster.map(e.first);
+            auto pixel = layered.at((size_t)p.x, h - 1 - (size_t)p.y);
+            auto channelDiff = [](uint8_t x, uint8_t y) { return x > y ? x - y : y - x; };
+            const int tolerance = 2;
+            if (channelDiff(pixel.r, e.second.r) > tolerance || channelDiff(pixel.g, e.second.g) > tolerance
+                || channelDiff(pixel.b, e.second.b) > tolerance || channelDiff(pixel.a, e.second.a) > tolerance)
+                cout << errorString("composited color differs from expected") << " " << RenderFormatToString(format)
+                    << " at " << p.x << "," << p.y << " " << (int)pixel.r << "," << (int)pixel.g << "," << (int)pixel.b
+                    << "," << (int)pixel.a << " expected " << (int)e.second.r << "," << (int)e.second.g << ","
+                    << (int)e.second.b << "," << (int)e.second.a << endl;
+        }
+
+        writeImageAsPng(layered, prefix(std::string(RenderFormatToString(format)) + ".png"));
+    }
+}
+
+TESTFUN(scene, framepipeline01){
+    using namespace dr4;
+    const unsigned w = 1280;
+    const unsigned h = 960;
+    const size_t frameCount = 8;
+    auto config = GetTestRasterConfig(w, h);
+    auto rasterizerConfig = RasterizerConfig::Tiled(128, 128);
+    std::vector<Scene2D> scenes;
+    for (size_t i = 0; i < frameCount; i++)
+        scenes.push_back(GetTestSceneLayers01(0.1f * (float)(i + 1)));
+    auto framePath = [this](size_t frame) { return prefix("frame" + std::to_string(frame) + ".png"); };
+
+    // Serial: render, resolve and encode one frame at a time
+    std::vector<ImageRGBA8SRGB> serial;
+    Timer serialTimer;
+    auto rasterizer = CreateRasterizer(w, h, rasterizerConfig);
+    for (size_t i = 0; i < frameCount; i++) {
+        RenderFrame(*rasterizer, config, scenes[i]);
+        serial.push_back(rasterizer->getColorAsSRGB());
+        writeImageAsPng(serial.back(), framePath(i));
+    }
+    double serialMs = serialTimer.milliseconds();
+
+    // Pipelined: resolve and encode of a frame overlaps rendering of the next ones
+    std::vector<ImageRGBA8SRGB> pipelined(frameCount, ImageRGBA8SRGB(1, 1));
+    Timer pipelineTimer;
+    {
+        FramePipelineConfig pipelineConfig;
+        pipelineConfig.depth = 3;
+        pipelineConfig.workers = 2;
+        pipelineConfig.rasterizer = rasterizerConfig;
+        FramePipeline pipeline(w, h, pipelineConfig);
+        for (size_t i = 0; i < frameCount; i++) {
+            pipeline.submit(config, scenes[i], [&, path = framePath(i)](size_t frame, const ImageRGBA8SRGB& image) {
+                pipelined[frame] = image;
+                writeImageAsPng(image, path);
+            });
+        }
+        pipeline.finish();
+    }
+    double pipelineMs = pipelineTimer.milliseconds();
+
+    size_t diff = 0;
+    for (size_t i = 0; i < frameCount; i++)
+        diff += CountDifferingPixels(serial[i], pipelined[i]);
+    if (diff != 0)
+        cout << errorString("pipelined frames differ from serial frames") << " " << diff << endl;
+    cout << "serial ms:" << serialMs << " pipelined ms:" << pipelineMs << endl;
+
+    // Scenes rebuilt at the same address every frame are rendered in full, also by incremental rasterizers
+    std::vector<ImageRGBA8SRGB> rebuilt(frameCount, ImageRGBA8SRGB(1, 1));
+    {
+        FramePipelineConfig pipelineConfig;
+        pipelineConfig.depth = 1;
+        pipelineConfig.rasterizer = rasterizerConfig.withIncremental();
+        FramePipeline pipeline(w, h, pipelineConfig);
+        for (size_t i = 0; i < frameCount; i++) {
+            Scene2D scene = GetTestSceneLayers01(0.1f * (float)(i + 1));
+            pipeline.submit(config, scene, [&](size_t frame, const ImageRGBA8SRGB& image) { rebuilt[frame] = image; });
+        }
+        pipeline.finish();
+    }
+    diff = 0;
+    for (size_t i = 0; i < frameCount; i++)
+        diff += CountDifferingPixels(serial[i], rebuilt[i]);
+    if (diff != 0)
+        cout << errorString("rebuilt scenes rendered from previous frames") << " " << diff << endl;
+}
+
+TESTFUN(scene, bandrender01){
+    using namespace dr4;
+    const unsigned w = 1000;
+    const unsigned h = 730;
+    Scene2D scene = GetTestSceneLayers01(0.5f);
+    auto config = GetTestRasterConfig(w, h);
+    auto reference = RenderScene(scene, w, h, RasterizerConfig::Tiled(128, 128));
+
+    // Collect bands to an image, band height does not divide the frame height
+    BandRenderConfig bandConfig;
+    bandConfig.bandHeight = 96;
+    bandConfig.rasterizer = RasterizerConfig::Tiled(128, 96);
+    ImageRGBA8SRGB banded(w, h);
+    size_t bandCount = 0;
+    std::string res = RenderBands(config, scene, [&](size_t firstRow, size_t rowCount, const SRGBA* rows) {
+        std::copy(rows, rows + rowCount * w, banded.data() + firstRow * w);
+        bandCount++;
+        return std::string();
+    }, bandConfig);
+    size_t diff = CountDifferingPixels(reference, banded);
+    if (!res.empty() || bandCount != 8 || diff != 0)
+        cout << errorString("banded output differs from full frame") << " " << res << " " << diff << endl;
+
+    // Stream to PNG and read back
+    Timer timer;
+    res = RenderBandsToPng(config, scene, prefix("streamed.png"), bandConfig);
+    cout << "streamed png ms:" << timer.milliseconds() << endl;
+    auto readBack = readImage(prefix("streamed.png"));
+    if (!res.empty() || !readBack.first || CountDifferingPixels(banded, *readBack.first) != 0)
+        cout << errorString("streamed png differs") << " " << res << readBack.second << endl;
+    writeImageAsPng(banded, prefix("banded.png"));
+}
+
+TESTFUN(scene, sceneindex01){
+    using namespace dr4;
+    const unsigned w = 800;
+    const unsigned h = 600;
+
+    // Large map of short strokes and small polygons, viewed zoomed in near the origin
+    Scene2DBuilder builder;
+    size_t layerIdx = builder.addLayer();
+    Material2D strokeMaterial = Material2D::CreateDefault();
+    strokeMaterial.linewidth = 3.f;
+    size_t strokeMaterialIdx = builder.addMaterial(strokeMaterial);
+    Material2D blockMaterial = Material2D::CreateDefault();
+    blockMaterial.colorFill = RGBAFloat32::Navy();
+    size_t blockMaterialIdx = builder.addMaterial(blockMaterial);
+    builder.add(layerIdx, ColorFill{ RGBAFloat32::White() });
+
+    RandIntGenerator random;
+    auto coord = [&random]() { return 200.f * ((float)(random.next() & 0xffff) / 65535.f - 0.5f); };
+    for (int c = 0; c < 16; c++) {
+        Line2DCollection lines;
+        lines.material = strokeMaterialIdx;
+        for (int i = 0; i < 20000; i++) {
+            float x = coord(), y = coord();
+            lines.append({ {x, y}, {x + 0.005f * coord(), y + 0.005f * coord()} });
+        }
+        builder.add(layerIdx, lines);
+    }
+    for (int i = 0; i < 2000; i++) {
+        float x = coord(), y = coord();
+        Polygon2D block = { {{{x, y}, {x + 0.4f, y}, {x + 0.4f, y + 0.3f}, {x, y + 0.3f}}} };
+        builder.add(layerIdx, PolygonFill2D::Create(block, blockMaterialIdx));
+    }
+    Scene2D scene = builder.build();
+
+    RasterDomain rasterDomain = RasterDomain::Create(w, h);
+    SceneDomain sceneDomain = { Span2f::Create({-8.f, -6.f}, {8.f, 6.f}) };
+    auto config = RasterConfig2D::Create(rasterDomain, sceneDomain);
+    auto rasterizerConfig = RasterizerConfig::Tiled(128, 128);
+
+    auto render = [&](const Scene2D& s, double& ms) {
+        auto rasterizer = CreateRasterizer(w, h, rasterizerConfig);
+        Timer timer;
+        RenderFrame(*rasterizer, config, s);
+        ms = timer.milliseconds();
+        return rasterizer->getColorAsSRGB();
+    };
+
+    double fullMs = 0.0, indexedMs = 0.0;
+    auto full = render(scene, fullMs);
+    Timer buildTimer;
+    scene.index = Scene2DIndex::Build(scene);
+    double buildMs = buildTimer.milliseconds();
+    auto indexed = render(scene, indexedMs);
+
+    size_t diff = CountDifferingPixels(full, indexed);
+    if (diff != 0)
+        cout << errorString("indexed render differs from full render") << " " << diff << endl;
+    cout << "full ms:" << fullMs << " indexed ms:" << indexedMs << " index build ms:" << buildMs << endl;
+    writeImageAsPng(indexed, prefix("indexed.png"));
+}
+
+TESTFUN(scene, profile01){
+    using namespace dr4;
+    const unsigned w = 1024;
+    const unsigned h = 768;
+    auto config = GetTestRasterConfig(w, h);
+    auto rasterizer = CreateRasterizer(w, h, RasterizerConfig::Tiled(128, 128));
+    ParallelExecutor executor;
+
+    // Profiling is off by default
+    Scene2D scene = GetTestSceneLayers01(0.5f);
+    {
+        FrameTasks tasks;
+        rasterizer->draw2D(config, scene, tasks);
+        executor.runBlock(tasks.tasks);
+        rasterizer->applyResult(tasks);
+        auto profile = CollectFrameProfile(tasks, 0);
+        if (!profile.tasks.empty() || !profile.steps.empty())
+            cout << errorString("profile recorded while disabled") << endl;
+    }
+
+    std::vector<FrameProfile> frames;
+    for (size_t i = 0; i < 3; i++) {
+        FrameTasks tasks;
+        tasks.profile = true;
+        rasterizer->draw2D(config, scene, tasks);
+        executor.runBlock(tasks.tasks);
+        rasterizer->applyResult(tasks);
+        frames.push_back(CollectFrameProfile(tasks, i));
+
+        auto summary = SummarizeFrame(frames.back());
+        if (summary.taskCount != tasks.tasks.size() || frames.back().steps.size() != 1 || summary.primitives == 0
+            || summary.pixels < (uint64_t)w * h)
+            cout << errorString("incomplete frame profile") << endl;
+        cout << "frame " << i << " tasks:" << summary.taskCount << " threads:" << summary.threadCount
+            << " wall ms:" << summary.wallMs << " task ms:" << summary.taskMs << " max task ms:" << summary.maxTaskMs
+            << " primitives:" << summary.primitives << " pixels:" << summary.pixels
+            << " bytes:" << summary.bytesAllocated << endl;
+    }
+    auto res = writeChromeTrace(frames, prefix("trace.json"));
+    if (!res.empty())
+        cout << errorString(res) << endl;
+}
+
+TESTFUN(scene, batchrender01){
+    using namespace dr4;
+    const unsigned w = 640;
+    const unsigned h = 480;
+
+    // Scenes written as JSON and rendered at two sizes, so that render buffers are reused between jobs
+    std::vector<Scene2D> scenes = { GetTestSceneLayers01(0.5f), GetTestSceneRandomLines(200), GetTestSceneLayers01(0.25f) };
+    JsonParser parser;
+    std::string manifest = "{\"width\":" + std::to_string(w) + ",\"height\":" + std::to_string(h) + ",\"jobs\":[";
+    for (size_t i = 0; i < 12; i++) {
+        std::string scenePath = prefix("scene" + std::to_string(i % scenes.size()) + ".json");
+        if (i < scenes.size()) {
+            std::string json = parser.toJson(scenes[i]).toString();
+            writeBytesToPath(std::vector<uint8_t>(json.begin(), json.end()), scenePath.c_str());
+        }
+        manifest += std::string(i ? "," : "") + "{\"scene\":\"" + scenePath + "\",\"output\":\""
+            + prefix("out" + std::to_string(i) + ".png") + "\"" + (i % 2 ? ",\"width\":320,\"height\":240" : "") + "}";
+    }
+    manifest += "]}";
+    writeBytesToPath(std::vector<uint8_t>(manifest.begin(), manifest.end()), prefix("manifest.json").c_str());
+
+    std::vector<BatchJob> jobs;
+    std::string res = ReadBatchManifest(prefix("manifest.json"), jobs);
+    if (!res.empty() || jobs.size() != 12)
+        cout << errorString("could not read manifest") << " " << res << endl;
+
+    BatchRenderConfig config;
+    config.workers = 4;
+    BatchReport report = RenderBatch(jobs, config);
+    cout << "batch ms:" << report.wallMs << " jobs/s:" << report.jobsPerSecond()
+        << " render buffers:" << report.rasterizersCreated << endl;
+    if (report.failed != 0 || report.rasterizersCreated > 2 * config.workers)
+        cout << errorString("batch failed") << " " << report.failed << endl;
+
+    // Batch output matches direct rendering of the original scenes
+    for (size_t i = 0; i < 2 * scenes.size(); i += 2) {
+        auto reference = RenderScene(scenes[i % scenes.size()], w, h, config.rasterizer);
+        auto readBack = readImage(prefix("out" + std::to_string(i) + ".png"));
+        if (!readBack.first || CountDifferingPixels(reference, *readBack.first) != 0)
+            cout << errorString("batch output differs") << " " << i << readBack.second << endl;
+    }
+    auto reportJson = BatchReportJson(jobs, report);
+    writeBytesToPath(std::vector<uint8_t>(reportJson.begin(), reportJson.end()), prefix("report.json").c_str());
+
+    // Sizes of the wrong type are reported as errors, and a negative size does not wrap to a huge image
+    const std::string badManifests[] = {
+        "{\"width\":-640,\"height\":480,\"jobs\":[{\"scene\":\"a.json\",\"output\":\"a.png\"}]}",
+        "{\"width\":\"640\",\"height\":480,\"jobs\":[{\"scene\":\"a.json\",\"output\":\"a.png\"}]}",
+        "{\"jobs\":[{\"scene\":\"a.json\",\"output\":\"a.png\",\"width\":640.5,\"height\":480}]}",
+        "{\"jobs\":[{\"scene\":\"a.json\",\"output\":\"a.png\",\"width\":640,\"height\":null}]}" };
+    for (const auto& bad : badManifests) {
+        writeBytesToPath(std::vector<uint8_t>(bad.begin(), bad.end()), prefix("bad_manifest.json").c_str());
+        std::vector<BatchJob> badJobs;
+        if (ReadBatchManifest(prefix("bad_manifest.json"), badJobs).empty())
+            cout << errorString("invalid manifest accepted") << " " << bad << endl;
+    }
+}
+
+TESTFUN(scene, sceneincremental01){
+    using namespace dr4;
+    const unsigned w = 640;
+    const unsigned h = 480;
+    Scene2D scene = GetTestScenePolygons01();
+
+    // Short line collections on their own layer, each a separate element
+    Material2D strokeMaterial = Material2D::CreateDefault();
+    strokeMaterial.linewidth = 5.f;
+    scene.materials.push_back(strokeMaterial);
+    Layer strokeLayer;
+    strokeLayer.blend = Blend::Default();
+    for (int i = 0; i < 8; i++) {
+        float x = -0.6f + 0.15f * i;
+        Line2DCollection lines;
+        lines.material = scene.materials.size() - 1;
+        lines.append({ {x, -0.4f}, {x + 0.05f, -0.3f} });
+        scene.lines.push_back(lines);
+        strokeLayer.graphics.push_back({ Content2D::Lines, scene.lines.size() - 1 });
+    }
+    scene.layers.push_back(strokeLayer);
+    scene.markAllChanged();
+    const size_t strokeLayerIdx = scene.layers.size() - 1;
+
+    auto config = GetTestRasterConfig(w, h);
+    auto rasterizer = CreateRasterizer(w, h, RasterizerConfig::Tiled(64, 64).withIncremental());
+    size_t fullTasks = RenderFrame(*rasterizer, config, scene);
+
+    // Unchanged scene renders nothing
+    size_t unchangedTasks = RenderFrame(*rasterizer, config, scene);
+
+    // Move one stroke
+    const size_t movedElement = 3;
+    auto& moved = scene.lines[scene.layers[strokeLayerIdx].graphics[movedElement].idx];
+    moved.lines[0].fst.y += 0.2f;
+    moved.lines[0].snd.y += 0.2f;
+    scene.markChanged(strokeLayerIdx, movedElement);
+    size_t incrementalTasks = RenderFrame(*rasterizer, config, scene);
+
+    auto incremental = rasterizer->getColorAsSRGB();
+    auto reference = RenderScene(scene, w, h, RasterizerConfig::SingleTile());
+    size_t diff = CountDifferingPixels(reference, incremental);
+    if (diff != 0 || unchangedTasks != 0 || incrementalTasks >= fullTasks)
+        cout << errorString("incremental frame differs from full frame") << " " << diff
+            << " tasks " << fullTasks << " " << unchangedTasks << " " << incrementalTasks << endl;
+
+    writeImageAsPng(incremental, prefix("incremental.png"));
+
+    // Another scene at the same address is rendered in full
+    scene = GetTestScenePolygons01();
+    size_t replacedTasks = RenderFrame(*rasterizer, config, scene);
+    diff = CountDifferingPixels(RenderScene(scene, w, h, RasterizerConfig::SingleTile()), rasterizer->getColorAsSRGB());
+    if (diff != 0 || replacedTasks == 0)
+        cout << errorString("replaced scene rendered from previous frame") << " " << diff << " tasks " << replacedTasks << endl;
+
+    // Without incremental rendering, edits need not be registered
+    auto full = CreateRasterizer(w, h, RasterizerConfig::Tiled(64, 64));
+    RenderFrame(*full, config, scene);
+    scene.materials[1].colorFill = RGBAFloat32::Blue();
+    RenderFrame(*full, config, scene);
+    diff = CountDifferingPixels(RenderScene(scene, w, h, RasterizerConfig::SingleTile()), full->getColorAsSRGB());
+    if (diff != 0)
+        cout << errorString("unregistered edit not rendered") << " " << diff << endl;
+}
+
 TESTFUN(rasterize, drawRandomLines){
 //void testDrawRandLines() {
     using namespace dr4;
@@ -396,13 +1015,16 @@ TESTFUN(sdf, sdf1){
     RGBAFloat32 col1 = RGBAFloat32::Orange();
     RGBAFloat32 col2 = RGBAFloat32::Navy();
 
-    for (unsigned y = 0; y < image.dim2(); y++){
-        for (unsigned x = 0; x < image.dim1(); x++){
-            float dist = quadtree.getDeepSample((float)x, (float)y);
-            RGBAFloat32 col = Lerp(col1, col2, fabsf(sin(dist/2)));
-            ptr.SetPixeli(x, y,  col);
+    // Blocks keep the quadtree nodes they sample in cache
+    parallelFor2D(image, ParallelGrain::Blocks(64, 4096), [&](const ParallelRange2D& block) {
+        for (unsigned y = (unsigned)block.y0; y < block.y1; y++){
+            for (unsigned x = (unsigned)block.x0; x < block.x1; x++){
+                float dist = quadtree.getDeepSample((float)x, (float)y);
+                RGBAFloat32 col = Lerp(col1, col2, fabsf(sin(dist/2)));
+                ptr.SetPixeli(x, y,  col);
+            }
         }
-    }
+    });
     ptr.writeOut(prefix("2_sdf_field.png"));
 #endif
 
@@ -445,13 +1067,15 @@ TESTFUN(sdf, sdf1){
     //RGBAFloat32 col1 = RGBAFloat32::Orange();
     //RGBAFloat32 col2 = RGBAFloat32::Navy();
 
-    for (unsigned y = 0; y < image.dim2(); y++){
-        for (unsigned x = 0; x < image.dim1(); x++){
-            float dist = realDists.at(x, y);
-            RGBAFloat32 col = Lerp(col1, col2, fabsf(sin(dist/2)));
-            ptr.SetPixeli(x, y,  col);
+    parallelFor2D(image, ParallelGrain::Rows(4096), [&](const ParallelRange2D& band) {
+        for (unsigned y = (unsigned)band.y0; y < band.y1; y++){
+            for (unsigned x = 0; x < image.dim1(); x++){
+                float dist = realDists.at(x, y);
+                RGBAFloat32 col = Lerp(col1, col2, fabsf(sin(dist/2)));
+                ptr.SetPixeli(x, y,  col);
+            }
         }
-    }
+    });
     ptr.writeOut(prefix("2_sdf_field_real.png"));
     
     // print out value difference
@@ -495,14 +1119,16 @@ TESTFUN(sdf, sdf1){
     std::cout << "max diff:" << mx << " min diff:" << mn << std::endl;
     // output dif values
     image.setAll(white);
-    for (unsigned y = 0; y < image.dim2(); y++){
-        for (unsigned x = 0; x < image.dim1(); x++){
-            float dist = distDiff.at(x, y);
-            float val = clampf((dist - mn) / dm, 0.f, 1.f);
-            RGBAFloat32 col = Lerp(col1, col2, val);
-            ptr.SetPixeli(x, y,  col);
+    parallelFor2D(image, ParallelGrain::Rows(4096), [&](const ParallelRange2D& band) {
+        for (unsigned y = (unsigned)band.y0; y < band.y1; y++){
+            for (unsigned x = 0; x < image.dim1(); x++){
+                float dist = distDiff.at(x, y);
+                float val = clampf((dist - mn) / dm, 0.f, 1.f);
+                RGBAFloat32 col = Lerp(col1, col2, val);
+                ptr.SetPixeli(x, y,  col);
+            }
         }
-    }
+    });
     ptr.writeOut(prefix("2_sdf_field_diff.png"));
 
 #endif
@@ -573,14 +1199,16 @@ TESTFUN(sdf, SDFPolygon){
 
     RGBAFloat32 col1 = RGBAFloat32::White();
     RGBAFloat32 col2 = RGBAFloat32::Red();
-    for (unsigned y = 0; y < image.dim2(); y++){
-        for (unsigned x = 0; x < image.dim1(); x++){
-            float dist = quadtree.getDeepSample((float)x, (float)y);
-            float u = clampf(dist / 100.f, 0.f, 1.f);
-            RGBAFloat32 col = Lerp(col1, col2, u);
-            ptr.SetPixeli(x, y,  col);
+    parallelFor2D(image, ParallelGrain::Blocks(64, 4096), [&](const ParallelRange2D& block) {
+        for (unsigned y = (unsigned)block.y0; y < block.y1; y++){
+            for (unsigned x = (unsigned)block.x0; x < block.x1; x++){
+                float dist = quadtree.getDeepSample((float)x, (float)y);
+                float u = clampf(dist / 100.f, 0.f, 1.f);
+                RGBAFloat32 col = Lerp(col1, col2, u);
+                ptr.SetPixeli(x, y,  col);
+            }
         }
-    }
+    });
 #endif
 
     ptr.writeOut(prefix("sdf.png"));
@@ -667,6 +1295,29 @@ TESTFUN(common, gradient01){
     outputGradient(grad4, prefix("grad04.png"));
 }
 
+TESTFUN(common, gradient02){
+    using namespace dr4;
+    const size_t w = 640;
+    const size_t h = 480;
+    GradientFloat32 grad = { { {0.0f, RGBAFloat32::Red()}, {0.6f, RGBAFloat32::Yellow()}, {1.f, RGBAFloat32::Blue() }} };
+    auto lut = GradientToLUT(grad);
+
+    const GradientGeometry geometries[] = {
+        GradientGeometry::Linear({ 40.f, 40.f }, { 600.f, 440.f }),
+        GradientGeometry::Radial({ 320.f, 240.f }, 300.f),
+        GradientGeometry::Conic({ 320.f, 240.f }, 0.5f) };
+    const char* names[] = { "linear.png", "radial.png", "conic.png" };
+
+    for (size_t i = 0; i < 3; i++) {
+        ImageRGBA32Linear image(w, h, RGBAFloat32::Navy());
+        Painter painter(image);
+        Timer timer;
+        painter.fillGradient(geometries[i], lut, RasterDomain::Create({ 20, 20 }, w - 40, h - 40));
+        cout << names[i] << " ms:" << timer.milliseconds() << endl;
+        painter.writeOut(prefix(names[i]));
+    }
+}
+
 //
 // Interpolation tests
 //
@@ -836,6 +1487,18 @@ int main()
         //RN(gradient01),
         //RN(interpolate01)
         RN(scenetest01),
+        RN(scenetiled01),
+        RN(scenepolygons01),
+        RN(scenestrokes01),
+        RN(sceneincremental01),
+        RN(sceneformats01),
+        RN(scenelayers01),
+        RN(framepipeline01),
+        RN(bandrender01),
+        RN(sceneindex01),
+        RN(profile01),
+        RN(batchrender01),
+        RN(gradient02),
         RN(handlebuffertest)
     };
 
@@ -0,0 +1,82 @@
+// Render the Scene2D JSON files of a manifest to PNG files in parallel, see ReadBatchManifest for the format.
+//
+// Usage: batchrender manifest.json [--workers N] [--tile W H] [--report report.json]
+
+#include <dr4/dr4_batchrender.h>
+#include <dr4/dr4_io.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+	const char* Usage = "Usage: batchrender manifest.json [--workers N] [--tile W H] [--report report.json]";
+}
+
+int main(int argc, char* argv[]) {
+	string manifestPath;
+	string reportPath;
+	dr4::BatchRenderConfig config;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--workers" && i + 1 < argc)
+			config.workers = (size_t)strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--tile" && i + 2 < argc) {
+			unsigned w = (unsigned)strtoul(argv[++i], nullptr, 10);
+			unsigned h = (unsigned)strtoul(argv[++i], nullptr, 10);
+			config.rasterizer = dr4::RasterizerConfig::Tiled(w, h);
+		}
+		else if (arg == "--report" && i + 1 < argc)
+			reportPath = argv[++i];
+		else if (manifestPath.empty() && !arg.empty() && arg[0] != '-')
+			manifestPath = arg;
+		else {
+			cerr << Usage << endl;
+			return 1;
+		}
+	}
+	if (manifestPath.empty()) {
+		cerr << Usage << endl;
+		return 1;
+	}
+
+	vector<dr4::BatchJob> jobs;
+	string res = dr4::ReadBatchManifest(manifestPath, jobs);
+	if (!res.empty()) {
+		cerr << res << endl;
+		return 1;
+	}
+
+	mutex outputMutex;
+	config.progress = [&](size_t jobIndex, const dr4::BatchJobResult& result) {
+		lock_guard<mutex> lock(outputMutex);
+		const auto& job = jobs[jobIndex];
+		if (result.error.empty()) {
+			cout << job.outputPath << " " << job.width << "x" << job.height << " read " << result.readMs
+				<< " ms, parse " << result.parseMs << " ms, render " << result.renderMs << " ms, encode "
+				<< result.encodeMs << " ms" << endl;
+		}
+		else {
+			cerr << job.scenePath << ": " << result.error << endl;
+		}
+	};
+
+	dr4::BatchReport report = dr4::RenderBatch(jobs, config);
+	cout << report.results.size() - report.failed << "/" << report.results.size() << " jobs rendered in "
+		<< report.wallMs << " ms with " << report.workers << " workers, " << report.jobsPerSecond() << " jobs/s, "
+		<< report.rasterizersCreated << " render buffers" << endl;
+
+	if (!reportPath.empty()) {
+		string json = dr4::BatchReportJson(jobs, report);
+		res = dr4::writeBytesToPath(vector<uint8_t>(json.begin(), json.end()), reportPath.c_str());
+		if (!res.empty()) {
+			cerr << res << endl;
+			return 1;
+		}
+	}
+	return report.failed ? 1 : 0;
+}